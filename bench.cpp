@@ -0,0 +1,456 @@
+// g++ -O2 -std=c++17 bench.cpp -o bench && ./bench
+// ./bench --suite --json=results.json runs only the hot-path suite and writes it as JSON.
+// Add -DBENCH_GMP -lgmp to time the same corpora against GMP.
+#define BIGNUM_NO_MAIN
+#include "main.cpp"
+
+#include <chrono>
+#include <fstream>
+#include <random>
+
+#if defined(BENCH_GMP) && __has_include(<gmp.h>)
+#include <gmp.h>
+#define BENCH_HAVE_GMP 1
+#endif
+
+namespace {
+
+std::mt19937_64 rng(20240601);
+
+std::string random_digits(size_t len) {
+  std::string s(1, static_cast<char>('1' + rng() % 9));
+  while (s.size() < len)
+    s += static_cast<char>('0' + rng() % 10);
+  return s;
+}
+
+BigInteger random_limbs(size_t limbs) {
+  static const char *hex = "0123456789ABCDEF";
+  std::string s(1, hex[1 + rng() % 15]);
+  while (s.size() < 8 * limbs)
+    s += hex[rng() % 16];
+  return {s, 16};
+}
+
+// The pre-divmod operator/: binary search for the quotient, one full multiply per step.
+BigInteger binary_search_divide(const BigInteger &dividend, const BigInteger &divisor) {
+  BigInteger one(1, dividend.get_base()), two(2, dividend.get_base());
+  BigInteger left(0, dividend.get_base());
+  BigInteger right = dividend + one;
+  while (left + one < right) {
+    BigInteger middle = (left + right) / two;
+    if (middle * divisor <= dividend)
+      left = middle;
+    else
+      right = middle;
+  }
+  return left;
+}
+
+// The pre-Lehmer gcd(): Euclid on operator%, written iteratively so large inputs do not overflow the stack.
+BigInteger euclid_gcd(BigInteger a, BigInteger b) {
+  while (b != 0) {
+    BigInteger r = a % b;
+    a = std::move(b);
+    b = std::move(r);
+  }
+  return a;
+}
+
+template<class F>
+double time_ms(int reps, F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < reps; ++i)
+    f();
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / reps;
+}
+
+void bench_division() {
+  std::cout << std::setw(10) << "dividend" << std::setw(10) << "divisor"
+            << std::setw(16) << "binsearch ms" << std::setw(14) << "divmod ms"
+            << std::setw(10) << "speedup" << std::endl;
+  const size_t sizes[][2] = {{50, 25}, {100, 50}, {200, 100}, {500, 250}, {1000, 500}, {2000, 1000}};
+  for (auto size : sizes) {
+    BigInteger a(random_digits(size[0]), 10), b(random_digits(size[1]), 10);
+    int reps = size[0] <= 200 ? 5 : 1;
+    double legacy = time_ms(reps, [&] { binary_search_divide(a, b); });
+    double knuth = time_ms(reps * 20, [&] { BigInteger::divmod(a, b); });
+    std::cout << std::setw(10) << size[0] << std::setw(10) << size[1]
+              << std::setw(16) << std::fixed << std::setprecision(3) << legacy
+              << std::setw(14) << knuth
+              << std::setw(10) << std::setprecision(1) << legacy / knuth << std::endl;
+  }
+}
+
+// Times one top-level multiply per tier; the lower tiers keep their current thresholds.
+void calibrate_multiplication() {
+  const size_t never = static_cast<size_t>(-1);
+  std::cout << std::setw(10) << "limbs" << std::setw(16) << "karatsuba ms"
+            << std::setw(14) << "toom3 ms" << std::setw(12) << "ntt ms" << std::endl;
+  size_t toom3_from = 0, ntt_from = 0;
+  for (size_t limbs = 64; limbs <= 65536; limbs *= 2) {
+    BigInteger a = random_limbs(limbs), b = random_limbs(limbs);
+    int reps = limbs <= 1024 ? 20 : 3;
+    BigInteger::set_ntt_threshold(never);
+    BigInteger::set_toom3_threshold(never);
+    double karatsuba = time_ms(reps, [&] { a * b; });
+    BigInteger::set_toom3_threshold(limbs);
+    double toom3 = time_ms(reps, [&] { a * b; });
+    BigInteger::set_ntt_threshold(limbs);
+    double ntt = time_ms(reps, [&] { a * b; });
+    if (!toom3_from && toom3 < karatsuba)
+      toom3_from = limbs;
+    if (!ntt_from && ntt < std::min(karatsuba, toom3))
+      ntt_from = limbs;
+    std::cout << std::setw(10) << limbs << std::setw(16) << std::fixed << std::setprecision(3) << karatsuba
+              << std::setw(14) << toom3 << std::setw(12) << ntt << std::endl;
+  }
+  std::cout << "suggested thresholds: toom3 " << toom3_from << ", ntt " << ntt_from << " limbs" << std::endl;
+  BigInteger::set_toom3_threshold(toom3_from ? toom3_from : never);
+  BigInteger::set_ntt_threshold(ntt_from ? ntt_from : never);
+}
+
+// Times one Burnikel-Ziegler level over Knuth's algorithm D on 2n / n limb divisions, then the Newton
+// tier on 4n / n, where its reciprocal is shared by three quotient blocks.
+void calibrate_division() {
+  const size_t never = static_cast<size_t>(-1);
+  std::cout << std::setw(10) << "limbs" << std::setw(12) << "knuth ms" << std::setw(10) << "bz ms" << std::endl;
+  size_t bz_from = 0, newton_from = 0;
+  BigInteger::set_newton_division_threshold(never);
+  for (size_t limbs = 32; limbs <= 1024; limbs *= 2) {
+    BigInteger a = random_limbs(2 * limbs), b = random_limbs(limbs);
+    BigInteger::set_burnikel_ziegler_threshold(never);
+    double knuth = time_ms(20, [&] { BigInteger::divmod(a, b); });
+    BigInteger::set_burnikel_ziegler_threshold(limbs);
+    double bz = time_ms(20, [&] { BigInteger::divmod(a, b); });
+    if (!bz_from && bz < knuth)
+      bz_from = limbs;
+    std::cout << std::setw(10) << limbs << std::setw(12) << std::fixed << std::setprecision(3) << knuth
+              << std::setw(10) << bz << std::endl;
+  }
+  BigInteger::set_burnikel_ziegler_threshold(bz_from ? bz_from : never);
+
+  std::cout << std::setw(10) << "limbs" << std::setw(16) << "bz 4n/n ms" << std::setw(16) << "newton 4n/n ms"
+            << std::endl;
+  for (size_t limbs = 1024; limbs <= 16384; limbs *= 2) {
+    BigInteger a = random_limbs(4 * limbs), b = random_limbs(limbs);
+    int reps = limbs <= 4096 ? 5 : 1;
+    BigInteger::set_newton_division_threshold(never);
+    double bz = time_ms(reps, [&] { BigInteger::divmod(a, b); });
+    BigInteger::set_newton_division_threshold(limbs);
+    double newton = time_ms(reps, [&] { BigInteger::divmod(a, b); });
+    if (!newton_from && newton < bz)
+      newton_from = limbs;
+    std::cout << std::setw(10) << limbs << std::setw(16) << std::fixed << std::setprecision(3) << bz
+              << std::setw(16) << newton << std::endl;
+  }
+  std::cout << "suggested thresholds: burnikel-ziegler " << bz_from << ", newton " << newton_from << " limbs"
+            << std::endl;
+  BigInteger::set_newton_division_threshold(newton_from ? newton_from : never);
+}
+
+void bench_gcd() {
+  std::cout << std::setw(10) << "limbs" << std::setw(14) << "euclid ms" << std::setw(14) << "lehmer ms"
+            << std::setw(16) << "extended ms" << std::setw(10) << "speedup" << std::endl;
+  for (size_t limbs : {16, 64, 256, 1024, 4096}) {
+    BigInteger common = random_limbs(limbs / 8 + 1);
+    BigInteger a = random_limbs(limbs) * common, b = random_limbs(limbs - limbs / 16) * common;
+    int reps = limbs <= 256 ? 20 : 2;
+    double euclid = time_ms(reps, [&] { euclid_gcd(a, b); });
+    double lehmer = time_ms(reps, [&] { gcd(a, b); });
+    BigInteger x, y;
+    double extended = time_ms(reps, [&] { extended_gcd(a, b, x, y); });
+    std::cout << std::setw(10) << limbs << std::setw(14) << std::fixed << std::setprecision(3) << euclid
+              << std::setw(14) << lehmer << std::setw(16) << extended
+              << std::setw(10) << std::setprecision(1) << euclid / lehmer << std::endl;
+  }
+}
+
+void bench_parallel_multiplication() {
+  size_t threads = std::max(2u, std::thread::hardware_concurrency());
+  std::cout << std::setw(10) << "limbs" << std::setw(14) << "serial ms"
+            << std::setw(14) << "parallel ms" << std::setw(10) << "threads" << std::setw(10) << "equal" << std::endl;
+  for (size_t limbs : {4096, 16384, 65536, 262144}) {
+    BigInteger a = random_limbs(limbs), b = random_limbs(limbs);
+    BigInteger serial_product, parallel_product;
+    BigInteger::set_parallel_multiply(1);
+    double serial = time_ms(3, [&] { serial_product = a * b; });
+    BigInteger::set_parallel_multiply(threads, 2048);
+    double parallel = time_ms(3, [&] { parallel_product = a * b; });
+    BigInteger::set_parallel_multiply(1);
+    std::cout << std::setw(10) << limbs << std::setw(14) << std::fixed << std::setprecision(3) << serial
+              << std::setw(14) << parallel << std::setw(10) << threads
+              << std::setw(10) << (serial_product == parallel_product ? "yes" : "NO") << std::endl;
+  }
+}
+
+// One row of the hot-path suite. gmp_ms is negative when there is no GMP counterpart; base is 0 for
+// the limb kernels, whose sizes are in limbs.
+struct SuiteResult {
+  std::string name;
+  size_t size;
+  int base;
+  double ms;
+  double gmp_ms;
+};
+
+// Repeats f until at least min_ms has passed and returns the time per call.
+template<class F>
+double time_adaptive(F &&f, double min_ms = 50) {
+  for (int reps = 1;; reps *= 2) {
+    double per_call = time_ms(reps, f);
+    if (per_call * reps >= min_ms || reps >= (1 << 20))
+      return per_call;
+  }
+}
+
+// Corpora are seeded from the case itself, so every run and every build times the same operands.
+std::string corpus_digits(size_t len, int base, uint64_t seed) {
+  std::mt19937_64 gen(seed * 1000003 + len * 31 + base);
+  static const char *digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  std::string s(1, digits[1 + gen() % (base - 1)]);
+  while (s.size() < len)
+    s += digits[gen() % base];
+  return s;
+}
+
+#ifdef BENCH_HAVE_GMP
+struct Mpz {
+  mpz_t value;
+  Mpz() { mpz_init(value); }
+  explicit Mpz(const std::string &digits, int base) { mpz_init_set_str(value, digits.c_str(), base); }
+  Mpz(const Mpz &) = delete;
+  ~Mpz() { mpz_clear(value); }
+};
+#endif
+
+class Suite {
+ public:
+  void run() {
+    bench_kernels();
+    bench_parse_and_print();
+    bench_arithmetic();
+    bench_reduction();
+    bench_period();
+    bench_bignum();
+  }
+
+  void print() const {
+    std::cout << std::setw(24) << std::left << "benchmark" << std::right << std::setw(10) << "size"
+              << std::setw(6) << "base" << std::setw(14) << "ms" << std::setw(14) << "gmp ms" << std::endl;
+    for (const SuiteResult &r : results) {
+      std::cout << std::setw(24) << std::left << r.name << std::right << std::setw(10) << r.size
+                << std::setw(6) << r.base << std::setw(14) << std::fixed << std::setprecision(6) << r.ms;
+      if (r.gmp_ms >= 0)
+        std::cout << std::setw(14) << r.gmp_ms;
+      std::cout << std::endl;
+    }
+  }
+
+  void write_json(std::ostream &out) const {
+    out << "{\n  \"gmp\": " << (have_gmp ? "true" : "false") << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const SuiteResult &r = results[i];
+      out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size
+          << ", \"base\": " << r.base << ", \"ms\": " << std::setprecision(6) << r.ms << ", \"gmp_ms\": ";
+      if (r.gmp_ms >= 0)
+        out << r.gmp_ms;
+      else
+        out << "null";
+      out << "}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+ private:
+#ifdef BENCH_HAVE_GMP
+  static constexpr bool have_gmp = true;
+#else
+  static constexpr bool have_gmp = false;
+#endif
+
+  void add(const std::string &name, size_t size, int base, double ms, double gmp_ms = -1) {
+    results.push_back({name, size, base, ms, gmp_ms});
+  }
+
+  // Every limb kernel set this CPU supports, called directly on the same operands; the dispatched
+  // set (LimbKernels::active) is left as it is.
+  void bench_kernels() {
+    for (size_t n : {8, 64, 1024, 16384}) {
+      std::mt19937_64 gen(n);
+      std::vector<uint32_t> a(n), b(n), out(n);
+      for (size_t i = 0; i < n; ++i)
+        a[i] = static_cast<uint32_t>(gen()), b[i] = static_cast<uint32_t>(gen());
+      std::vector<uint32_t> equal = a;
+      for (const LimbKernels::Set *set : LimbKernels::available()) {
+        double sum = time_adaptive([&] { set->add(out.data(), a.data(), b.data(), n, 0); }, 20);
+        double difference = time_adaptive([&] { set->sub(out.data(), a.data(), b.data(), n, 0); }, 20);
+        volatile int order = 0;
+        double compare = time_adaptive([&] { order = set->compare(a.data(), equal.data(), n); }, 20);
+        double gmp_add = -1, gmp_sub = -1, gmp_compare = -1;
+#ifdef BENCH_HAVE_GMP
+        if (sizeof(mp_limb_t) == 2 * sizeof(uint32_t) && n % 2 == 0) {
+          auto *x = reinterpret_cast<const mp_limb_t *>(a.data()), *y = reinterpret_cast<const mp_limb_t *>(b.data());
+          auto *z = reinterpret_cast<const mp_limb_t *>(equal.data());
+          auto *r = reinterpret_cast<mp_limb_t *>(out.data());
+          gmp_add = time_adaptive([&] { mpn_add_n(r, x, y, static_cast<mp_size_t>(n / 2)); }, 20);
+          gmp_sub = time_adaptive([&] { mpn_sub_n(r, x, y, static_cast<mp_size_t>(n / 2)); }, 20);
+          // mpn_cmp is inline in gmp.h; keep its result alive.
+          volatile int sign = 0;
+          gmp_compare = time_adaptive([&] { sign = mpn_cmp(x, z, static_cast<mp_size_t>(n / 2)); }, 20);
+        }
+#endif
+        add(std::string("add_") + set->name, n, 0, sum, gmp_add);
+        add(std::string("sub_") + set->name, n, 0, difference, gmp_sub);
+        add(std::string("compare_") + set->name, n, 0, compare, gmp_compare);
+      }
+    }
+  }
+
+  // Sizes are in digits of the named base.
+  void bench_parse_and_print() {
+    for (int base : {10, 16, 7}) {
+      for (size_t len : {100, 1000, 10000, 100000}) {
+        std::string digits = corpus_digits(len, base, 1);
+        BigInteger x(digits, base);
+        double parse = time_adaptive([&] { BigInteger parsed(digits, base); });
+        double print = time_adaptive([&] { (void)x.convert_to_string(base); });
+        double gmp_parse = -1, gmp_print = -1;
+#ifdef BENCH_HAVE_GMP
+        Mpz g(digits, base);
+        gmp_parse = time_adaptive([&] { Mpz parsed(digits, base); });
+        gmp_print = time_adaptive([&] { free(mpz_get_str(nullptr, base, g.value)); });
+#endif
+        add("parse", len, base, parse, gmp_parse);
+        add("convert_to_string", len, base, print, gmp_print);
+      }
+    }
+  }
+
+  void bench_arithmetic() {
+    for (size_t len : {100, 1000, 10000, 100000}) {
+      std::string da = corpus_digits(len, 10, 2), db = corpus_digits(len, 10, 3);
+      std::string dc = corpus_digits(2 * len, 10, 4), dd = corpus_digits(len / 8 + 1, 10, 5);
+      BigInteger a(da, 10), b(db, 10), c(dc, 10), common(dd, 10);
+      BigInteger ga = a * common, gb = b * common;
+      double mul = time_adaptive([&] { a * b; });
+      double div = time_adaptive([&] { BigInteger::divmod(c, a); });
+      double g = time_adaptive([&] { gcd(ga, gb); }, len >= 100000 ? 1 : 50);
+      double gmp_mul = -1, gmp_div = -1, gmp_gcd = -1;
+#ifdef BENCH_HAVE_GMP
+      Mpz ma(da, 10), mb(db, 10), mc(dc, 10), mcommon(dd, 10), mga, mgb, out, rem;
+      mpz_mul(mga.value, ma.value, mcommon.value);
+      mpz_mul(mgb.value, mb.value, mcommon.value);
+      gmp_mul = time_adaptive([&] { mpz_mul(out.value, ma.value, mb.value); });
+      gmp_div = time_adaptive([&] { mpz_tdiv_qr(out.value, rem.value, mc.value, ma.value); });
+      gmp_gcd = time_adaptive([&] { mpz_gcd(out.value, mga.value, mgb.value); });
+#endif
+      add("multiply", len, 10, mul, gmp_mul);
+      add("divide", 2 * len, 10, div, gmp_div);
+      add("gcd", len, 10, g, gmp_gcd);
+    }
+  }
+
+  // Eager reduction of a fraction whose terms share a factor of about an eighth of their length.
+  void bench_reduction() {
+    for (size_t len : {100, 1000, 10000}) {
+      std::string dn = corpus_digits(len, 10, 6), dd = corpus_digits(len, 10, 7);
+      std::string dc = corpus_digits(len / 8 + 1, 10, 8);
+      BigInteger common(dc, 10);
+      BigInteger num = BigInteger(dn, 10) * common, den = BigInteger(dd, 10) * common;
+      double reduce = time_adaptive([&] { BigFraction reduced(num, den); });
+      double gmp_reduce = -1;
+#ifdef BENCH_HAVE_GMP
+      Mpz mnum, mden, mcommon(dc, 10);
+      mpz_mul(mnum.value, Mpz(dn, 10).value, mcommon.value);
+      mpz_mul(mden.value, Mpz(dd, 10).value, mcommon.value);
+      gmp_reduce = time_adaptive([&] {
+        mpq_t q;
+        mpq_init(q);
+        mpz_set(mpq_numref(q), mnum.value);
+        mpz_set(mpq_denref(q), mden.value);
+        mpq_canonicalize(q);
+        mpq_clear(q);
+      });
+#endif
+      add("fraction_reduce", len, 10, reduce, gmp_reduce);
+    }
+    // A running sum read once at the end: eager mode reduces after every step, lazy mode only there.
+    for (size_t terms : {16, 64, 256}) {
+      std::vector<BigFraction> parts;
+      for (size_t i = 0; i < terms; ++i)
+        parts.emplace_back(BigInteger(corpus_digits(20, 10, 100 + i), 10), BigInteger(corpus_digits(20, 10, 1000 + i), 10));
+      auto sum = [&] {
+        BigFraction total;
+        for (const BigFraction &part : parts)
+          total += part;
+        (void)total.num();
+      };
+      add("fraction_sum_eager", terms, 10, time_adaptive(sum));
+      BigFraction::set_lazy_reduction(true);
+      add("fraction_sum_lazy", terms, 10, time_adaptive(sum));
+      BigFraction::set_lazy_reduction(false);
+    }
+  }
+
+  // 1/p for full-reptend primes in base 10: the period has the maximal length p - 1. The second
+  // group has many-digit denominators whose periods run past the 10000 digits convert_to_string keeps.
+  void bench_period() {
+    for (int p : {1019, 10007, 100019, 1000171}) {
+      BigFraction f(BigInteger(1), BigInteger(p));
+      add("period_full_reptend", static_cast<size_t>(p - 1), 10,
+          time_adaptive([&] { (void)f.convert_to_string_full(10); }, p > 100000 ? 1 : 50));
+    }
+    for (size_t len : {20, 50, 100}) {
+      BigInteger den = BigInteger(corpus_digits(len, 10, 9), 10) * BigInteger(40);
+      BigFraction f(BigInteger(1), den);
+      add("period_truncated", len, 10, time_adaptive([&] { (void)f.convert_to_string(10); }));
+    }
+  }
+
+  // Whole requests: a number with fractional and periodic parts, parsed and printed in another base.
+  void bench_bignum() {
+    const int pairs[][2] = {{10, 2}, {12, 10}, {10, 7}, {16, 36}};
+    for (auto pair : pairs) {
+      for (size_t len : {10, 100, 1000}) {
+        std::string text = corpus_digits(len, pair[0], 10) + "." + corpus_digits(len, pair[0], 11) +
+                           "(" + corpus_digits(len / 4 + 1, pair[0], 12) + ")";
+        add("bignum_" + std::to_string(pair[0]) + "_to_" + std::to_string(pair[1]), len, pair[0],
+            time_adaptive([&] { BigNum(text, pair[0]).convert_to_string(pair[1]); }));
+      }
+    }
+  }
+
+  std::vector<SuiteResult> results;
+};
+
+}
+
+int main(int argc, char **argv) {
+  bool suite_only = false;
+  std::string json_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--suite")
+      suite_only = true;
+    else if (arg.rfind("--json=", 0) == 0)
+      json_path = arg.substr(7);
+  }
+
+  if (!suite_only) {
+    bench_division();
+    calibrate_multiplication();
+    calibrate_division();
+    bench_parallel_multiplication();
+    bench_gcd();
+  }
+
+  Suite suite;
+  suite.run();
+  suite.print();
+  if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    suite.write_json(out);
+  }
+}
@@ -1,9 +1,13 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <cstring>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <cerrno>
 #include <utility>
 #include <vector>
 #include <algorithm>
@@ -11,280 +15,2142 @@
 #include <stdexcept>
 #include <cctype>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <list>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BIGNUM_X86_KERNELS 1
+#endif
+#include <sstream>
+
+// Work-stealing pool: every worker owns a deque, pops its own newest task and steals the oldest
+// task of another worker when idle. A thread waiting in run_all runs the unclaimed tasks of that
+// call itself, so nested run_all calls from inside tasks cannot deadlock, and the caller never
+// picks up unrelated queued work while it waits.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads) : queues(threads) {
+    for (auto &queue : queues)
+      queue = std::make_unique<Queue>();
+    for (size_t i = 0; i < threads; ++i)
+      workers.emplace_back([this, i] { worker_loop(i); });
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
 
-std::string to_string(int num){
-  std::string ans;
-  while (num){
-    ans+=static_cast<char>(48 + num%10);
-    num/=10;
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  [[nodiscard]] size_t size() const {
+    return workers.size();
+  }
+
+  // Runs all tasks on the calling thread and on idle workers, and returns once every task has
+  // finished. The first exception thrown by a task is rethrown here.
+  void run_all(std::vector<std::function<void()>> &tasks) {
+    if (tasks.empty())
+      return;
+    auto batch = std::make_shared<Batch>(tasks);
+    for (size_t i = 1; i < tasks.size(); ++i)
+      push([batch] { batch->run_next(); });
+    while (batch->run_next()) {}
+    batch->wait();
+    if (batch->error)
+      std::rethrow_exception(batch->error);
+  }
+
+  // Fire-and-forget. Queued at the front, so the owning worker (which pops the back) takes
+  // submitted tasks oldest first. The task must not throw.
+  void submit(std::function<void()> task) {
+    push(std::move(task), true);
+  }
+
+ private:
+  struct Queue {
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+  };
+
+  // The tasks of one run_all call, claimed by index by the caller and by the helpers it queued.
+  // A helper that finds every task claimed returns without touching the caller's vector.
+  struct Batch {
+    explicit Batch(std::vector<std::function<void()>> &tasks) : tasks(tasks), count(tasks.size()), remaining(count) {}
+
+    // Runs the next unclaimed task; false once all are claimed.
+    bool run_next() {
+      size_t index = next.fetch_add(1, std::memory_order_relaxed);
+      if (index >= count)
+        return false;
+      std::exception_ptr thrown;
+      try {
+        tasks[index]();
+      } catch (...) {
+        thrown = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (thrown && !error)
+        error = thrown;
+      if (--remaining == 0)
+        finished.notify_all();
+      return true;
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [this] { return remaining == 0; });
+    }
+
+    std::vector<std::function<void()>> &tasks;
+    const size_t count;
+    std::atomic<size_t> next{0};
+    size_t remaining;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> pending{0};
+  std::atomic<size_t> next_queue{0};
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  inline static thread_local int worker_index = -1;
+
+  void push(std::function<void()> task, bool at_front = false) {
+    size_t index = worker_index >= 0 ? static_cast<size_t>(worker_index)
+                                     : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+      std::lock_guard<std::mutex> lock(queues[index]->mutex);
+      if (at_front)
+        queues[index]->tasks.push_front(std::move(task));
+      else
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    pending.fetch_add(1, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+  }
+
+  bool try_run_one(size_t home) {
+    std::function<void()> task;
+    for (size_t i = 0; i < queues.size() && !task; ++i) {
+      Queue &queue = *queues[(home + i) % queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty())
+        continue;
+      if (i == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    if (!task)
+      return false;
+    pending.fetch_sub(1, std::memory_order_acq_rel);
+    task();
+    return true;
+  }
+
+  void worker_loop(size_t index) {
+    worker_index = static_cast<int>(index);
+    while (true) {
+      if (try_run_one(index))
+        continue;
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      wake.wait(lock, [this] { return stopping || pending.load(std::memory_order_acquire) != 0; });
+      if (stopping)
+        return;
+    }
+  }
+};
+
+enum class LogLevel { debug, info, warning, error, off };
+
+#ifndef BIGNUM_LOG_MIN_LEVEL
+#define BIGNUM_LOG_MIN_LEVEL debug
+#endif
+
+// Asynchronous logger. Callers push finished lines into a bounded lock-free ring (multi-producer,
+// sequence-numbered slots); one background thread writes them out, errors and warnings to stderr and
+// the rest to stdout, flushing once per batch. When the ring is full the line is dropped and counted
+// instead of blocking the caller.
+class Logger {
+ public:
+  static Logger &instance() {
+    static Logger logger;
+    return logger;
+  }
+
+  [[nodiscard]] static bool enabled(LogLevel level) {
+    return level >= threshold.load(std::memory_order_relaxed);
+  }
+
+  static void set_level(LogLevel level) {
+    threshold.store(level, std::memory_order_relaxed);
+  }
+
+  static LogLevel parse_level(const std::string &name) {
+    const char *names[] = {"debug", "info", "warning", "error", "off"};
+    for (int i = 0; i < 5; ++i) {
+      if (name == names[i])
+        return static_cast<LogLevel>(i);
+    }
+    throw std::invalid_argument("Unknown log level: " + name);
+  }
+
+  void push(LogLevel level, std::string line) {
+    size_t position = head_.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots_[position & (capacity - 1)];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+      if (lag == 0 && head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        break;
+      if (lag < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (lag > 0)
+        position = head_.load(std::memory_order_relaxed);
+    }
+    slot->level = level;
+    slot->text = std::move(line);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    if (idle_.load(std::memory_order_relaxed))
+      wake_.notify_one();
+  }
+
+  // Blocks until every line pushed before the call has been written.
+  void flush() {
+    size_t target = head_.load(std::memory_order_acquire);
+    while (written_.load(std::memory_order_acquire) < target) {
+      wake_.notify_one();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  [[nodiscard]] uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  ~Logger() {
+    stopping_.store(true, std::memory_order_release);
+    wake_.notify_one();
+    writer_.join();
+  }
+
+ private:
+  static constexpr size_t capacity = 1 << 12;
+
+  struct Slot {
+    std::atomic<size_t> sequence;
+    LogLevel level = LogLevel::info;
+    std::string text;
+  };
+
+  inline static std::atomic<LogLevel> threshold{LogLevel::info};
+
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<size_t> head_{0}, written_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<bool> idle_{false}, stopping_{false};
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::thread writer_;
+
+  Logger() : slots_(new Slot[capacity]) {
+    for (size_t i = 0; i < capacity; ++i)
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    writer_ = std::thread([this] { write_loop(); });
+  }
+
+  void write_loop() {
+    size_t tail = 0;
+    std::string out, err;
+    while (true) {
+      for (Slot *slot = &slots_[tail & (capacity - 1)];
+           slot->sequence.load(std::memory_order_acquire) == tail + 1; slot = &slots_[tail & (capacity - 1)]) {
+        (slot->level >= LogLevel::warning ? err : out).append(slot->text).append(1, '\n');
+        std::string().swap(slot->text);
+        slot->sequence.store(tail + capacity, std::memory_order_release);
+        ++tail;
+      }
+      if (!out.empty()) {
+        std::cout << out << std::flush;
+        out.clear();
+      }
+      if (!err.empty()) {
+        std::cerr << err << std::flush;
+        err.clear();
+      }
+      written_.store(tail, std::memory_order_release);
+      if (stopping_.load(std::memory_order_acquire) && tail == head_.load(std::memory_order_acquire))
+        return;
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      idle_.store(true, std::memory_order_relaxed);
+      wake_.wait_for(lock, std::chrono::milliseconds(10));
+      idle_.store(false, std::memory_order_relaxed);
+    }
+  }
+};
+
+// BIGNUM_LOG(info, "text " << value): the stream expression is only evaluated when the level is
+// enabled. Levels below BIGNUM_LOG_MIN_LEVEL are compiled out.
+#define BIGNUM_LOG(level, expression)                                                               \
+  do {                                                                                            \
+    if (LogLevel::level >= LogLevel::BIGNUM_LOG_MIN_LEVEL && Logger::enabled(LogLevel::level)) { \
+      std::ostringstream bignum_log_line;                                                         \
+      bignum_log_line << expression;                                                              \
+      Logger::instance().push(LogLevel::level, bignum_log_line.str());                            \
+    }                                                                                             \
+  } while (false)
+
+// Request phases the server reports latency for; see PhaseClock.
+enum class Phase { other, parse, construct, arithmetic, gcd, divide, format, count };
+
+constexpr const char *phase_names[] = {"other", "parse", "construct", "arithmetic", "gcd", "divide", "format"};
+constexpr size_t phase_count = static_cast<size_t>(Phase::count);
+
+// Nanoseconds one request spent in each phase. Batch items add to it from pool threads.
+struct RequestTimings {
+  std::array<std::atomic<uint64_t>, phase_count> ns{};
+  std::atomic<uint32_t> entered{0};
+};
+
+// Per-thread attribution of time to phases. A thread bound to a RequestTimings charges elapsed time
+// to its innermost open Scope, so nested phases are exclusive. Unbound threads pay one
+// thread_local check per Scope.
+class PhaseClock {
+  struct State {
+    RequestTimings *timings = nullptr;
+    Phase current = Phase::other;
+    uint64_t start = 0;
+
+    void charge(uint64_t now) {
+      timings->ns[static_cast<size_t>(current)].fetch_add(now - start, std::memory_order_relaxed);
+      start = now;
+    }
+  };
+
+  static State &state() {
+    thread_local State current;
+    return current;
+  }
+
+  static uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+ public:
+  class Bind {
+   public:
+    explicit Bind(RequestTimings *timings) : previous_(state()) {
+      uint64_t t = now();
+      if (previous_.timings)
+        state().charge(t);
+      state() = {timings, Phase::other, t};
+    }
+
+    ~Bind() {
+      uint64_t t = now();
+      if (state().timings)
+        state().charge(t);
+      state() = previous_;
+      state().start = t;
+    }
+
+    Bind(const Bind &) = delete;
+    Bind &operator=(const Bind &) = delete;
+
+   private:
+    State previous_;
+  };
+
+  class Scope {
+   public:
+    explicit Scope(Phase phase) {
+      State &s = state();
+      if (!s.timings)
+        return;
+      active_ = true;
+      s.charge(now());
+      previous_ = s.current;
+      s.current = phase;
+      s.timings->entered.fetch_or(1u << static_cast<size_t>(phase), std::memory_order_relaxed);
+    }
+
+    ~Scope() {
+      finish();
+    }
+
+    // Ends the phase before the end of the enclosing block.
+    void finish() {
+      if (!active_)
+        return;
+      active_ = false;
+      State &s = state();
+      s.charge(now());
+      s.current = previous_;
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    bool active_ = false;
+    Phase previous_ = Phase::other;
+  };
+
+  [[nodiscard]] static RequestTimings *timings() {
+    return state().timings;
+  }
+};
+
+// Carry-propagating kernels over equal-length limb arrays, chosen once per process from CPUID: AVX2
+// (8 limbs per step), SSE2 (4) or scalar. A vector step adds or subtracts all lanes at once, then
+// settles the carries between lanes with two lane masks: generate (the lane carried out by itself)
+// and propagate (the lane passes an incoming carry on: all ones when adding, zero when subtracting).
+// ((generate << 1 | carry_in) + propagate) ^ propagate marks the lanes that receive a carry.
+class LimbKernels {
+ public:
+  using limb = uint32_t;
+  // r[0..n) = a[0..n) +/- b[0..n) +/- carry; returns the carry or borrow out. r may alias a or b.
+  using carry_fn = limb (*)(limb *r, const limb *a, const limb *b, size_t n, limb carry);
+  // Sign of a[0..n) - b[0..n).
+  using compare_fn = int (*)(const limb *a, const limb *b, size_t n);
+
+  struct Set {
+    const char *name;
+    carry_fn add, sub;
+    compare_fn compare;
+  };
+
+  [[nodiscard]] static const Set &active() {
+    return *current().load(std::memory_order_relaxed);
+  }
+
+  // Scalar first, then every vector set this CPU supports.
+  [[nodiscard]] static std::vector<const Set *> available() {
+    std::vector<const Set *> sets{&scalar_set};
+#ifdef BIGNUM_X86_KERNELS
+    sets.push_back(&sse2_set);
+    if (__builtin_cpu_supports("avx2"))
+      sets.push_back(&avx2_set);
+#endif
+    return sets;
+  }
+
+  // For benchmarks and tests; the set must come from available().
+  static void use(const Set &set) {
+    current().store(&set, std::memory_order_relaxed);
   }
-  std::reverse(ans.begin(), ans.end());
-  return ans;
-}
 
+ private:
+  static std::atomic<const Set *> &current() {
+    static std::atomic<const Set *> set{available().back()};
+    return set;
+  }
+
+  static limb add_scalar(limb *r, const limb *a, const limb *b, size_t n, limb carry) {
+    uint64_t sum = carry;
+    for (size_t i = 0; i < n; ++i) {
+      sum += static_cast<uint64_t>(a[i]) + b[i];
+      r[i] = static_cast<limb>(sum);
+      sum >>= 32;
+    }
+    return static_cast<limb>(sum);
+  }
+
+  static limb sub_scalar(limb *r, const limb *a, const limb *b, size_t n, limb borrow) {
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t diff = static_cast<uint64_t>(a[i]) - b[i] - borrow;
+      r[i] = static_cast<limb>(diff);
+      borrow = static_cast<limb>(diff >> 63);
+    }
+    return borrow;
+  }
+
+  static int compare_scalar(const limb *a, const limb *b, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+      if (a[i] != b[i])
+        return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+  }
+
+  // Carry (or borrow) into each lane as a bit mask, and the one out of the top lane.
+  static unsigned settle_carries(unsigned generate, unsigned propagate, limb &carry, int lanes) {
+    unsigned ripple = ((generate << 1) | carry) + propagate;
+    carry = (ripple >> lanes) & 1;
+    return (ripple ^ propagate) & ((1u << lanes) - 1);
+  }
+
+  inline static const Set scalar_set{"scalar", add_scalar, sub_scalar, compare_scalar};
+
+#ifdef BIGNUM_X86_KERNELS
+  // Unsigned x < y per 32-bit lane as a bit mask, by flipping the sign bits for a signed compare.
+  static unsigned below_sse2(__m128i x, __m128i y) {
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpgt_epi32(_mm_xor_si128(y, bias), _mm_xor_si128(x, bias)))));
+  }
+
+  static __m128i lane_mask_sse2(unsigned mask) {
+    const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(static_cast<int>(mask)), bits), bits);
+  }
+
+  static limb add_sse2(limb *r, const limb *a, const limb *b, size_t n, limb carry) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      __m128i sum = _mm_add_epi32(x, y);
+      unsigned propagate = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(sum, _mm_set1_epi32(-1)))));
+      unsigned incoming = settle_carries(below_sse2(sum, x), propagate, carry, 4);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(r + i), _mm_sub_epi32(sum, lane_mask_sse2(incoming)));
+    }
+    return add_scalar(r + i, a + i, b + i, n - i, carry);
+  }
+
+  static limb sub_sse2(limb *r, const limb *a, const limb *b, size_t n, limb borrow) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      __m128i diff = _mm_sub_epi32(x, y);
+      unsigned propagate = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(diff, _mm_setzero_si128()))));
+      unsigned incoming = settle_carries(below_sse2(x, y), propagate, borrow, 4);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(r + i), _mm_add_epi32(diff, lane_mask_sse2(incoming)));
+    }
+    return sub_scalar(r + i, a + i, b + i, n - i, borrow);
+  }
+
+  static int compare_sse2(const limb *a, const limb *b, size_t n) {
+    for (; n >= 4; n -= 4) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + n - 4));
+      __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + n - 4));
+      unsigned differ = ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(x, y)))) & 0xF;
+      if (differ) {
+        size_t k = n - 4 + static_cast<size_t>(31 - __builtin_clz(differ));
+        return a[k] < b[k] ? -1 : 1;
+      }
+    }
+    return compare_scalar(a, b, n);
+  }
+
+  __attribute__((target("avx2"))) static unsigned below_avx2(__m256i x, __m256i y) {
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(
+        _mm256_cmpgt_epi32(_mm256_xor_si256(y, bias), _mm256_xor_si256(x, bias)))));
+  }
+
+  __attribute__((target("avx2"))) static __m256i lane_mask_avx2(unsigned mask) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), bits), bits);
+  }
+
+  __attribute__((target("avx2"))) static limb add_avx2(limb *r, const limb *a, const limb *b, size_t n, limb carry) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+      __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+      __m256i sum = _mm256_add_epi32(x, y);
+      unsigned propagate = static_cast<unsigned>(
+          _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(sum, _mm256_set1_epi32(-1)))));
+      unsigned incoming = settle_carries(below_avx2(sum, x), propagate, carry, 8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(r + i), _mm256_sub_epi32(sum, lane_mask_avx2(incoming)));
+    }
+    return add_sse2(r + i, a + i, b + i, n - i, carry);
+  }
+
+  __attribute__((target("avx2"))) static limb sub_avx2(limb *r, const limb *a, const limb *b, size_t n, limb borrow) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+      __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+      __m256i diff = _mm256_sub_epi32(x, y);
+      unsigned propagate = static_cast<unsigned>(
+          _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(diff, _mm256_setzero_si256()))));
+      unsigned incoming = settle_carries(below_avx2(x, y), propagate, borrow, 8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(r + i), _mm256_add_epi32(diff, lane_mask_avx2(incoming)));
+    }
+    return sub_sse2(r + i, a + i, b + i, n - i, borrow);
+  }
+
+  __attribute__((target("avx2"))) static int compare_avx2(const limb *a, const limb *b, size_t n) {
+    for (; n >= 8; n -= 8) {
+      __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + n - 8));
+      __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + n - 8));
+      unsigned differ = ~static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, y)))) & 0xFF;
+      if (differ) {
+        size_t k = n - 8 + static_cast<size_t>(31 - __builtin_clz(differ));
+        return a[k] < b[k] ? -1 : 1;
+      }
+    }
+    return compare_sse2(a, b, n);
+  }
+
+  inline static const Set sse2_set{"sse2", add_sse2, sub_sse2, compare_sse2};
+  inline static const Set avx2_set{"avx2", add_avx2, sub_avx2, compare_avx2};
+#endif
+};
+
+// Division by a limb that stays fixed across many divisions (Moller and Granlund, "Improved division
+// by invariant integers"). The divisor is shifted left until its top bit is set; one hardware division
+// then gives the reciprocal v = floor((2^64 - 1) / d) - 2^32. After that, each two-limb by one-limb step
+// costs two multiplications and at most two corrections.
+class LimbDivisor {
+ public:
+  using limb = uint32_t;
+  using double_limb = uint64_t;
+
+  explicit LimbDivisor(limb d) {
+    if (d == 0)
+      throw std::invalid_argument("Division by zero");
+    shift_ = __builtin_clz(d);
+    d_ = d << shift_;
+    v_ = static_cast<limb>(((static_cast<double_limb>(~d_) << 32) | 0xFFFFFFFFu) / d_);
+  }
+
+  [[nodiscard]] limb value() const {
+    return d_ >> shift_;
+  }
+
+  // Quotient of x < d * 2^32, with x % d left in rem.
+  [[nodiscard]] limb divide(double_limb x, limb &rem) const {
+    x <<= shift_;
+    limb r;
+    limb q = step(static_cast<limb>(x >> 32), static_cast<limb>(x), r);
+    rem = r >> shift_;
+    return q;
+  }
+
+  // a[0..n) /= d in place, most significant limb last; returns the remainder.
+  limb divide(limb *a, size_t n) const {
+    if (n == 0)
+      return 0;
+    limb r = shift_ ? a[n - 1] >> (32 - shift_) : 0;
+    for (size_t i = n; i-- > 0;) {
+      limb low = a[i] << shift_;
+      if (shift_ && i)
+        low |= a[i - 1] >> (32 - shift_);
+      a[i] = step(r, low, r);
+    }
+    return r >> shift_;
+  }
+
+ private:
+  // (high, low) / d_ for high < d_; d_ is normalized.
+  limb step(limb high, limb low, limb &rem) const {
+    double_limb q = static_cast<double_limb>(v_) * high + ((static_cast<double_limb>(high) << 32) | low);
+    limb q1 = static_cast<limb>(q >> 32) + 1, q0 = static_cast<limb>(q);
+    limb r = low - q1 * d_;
+    if (r > q0) {
+      --q1;
+      r += d_;
+    }
+    if (r >= d_) {
+      ++q1;
+      r -= d_;
+    }
+    rem = r;
+    return q1;
+  }
+
+  limb d_, v_;
+  int shift_;
+};
+
+// Vector of trivially copyable T that keeps up to N elements inside the object and only allocates
+// past that. Covers the part of the std::vector interface the limb code uses; iterators are pointers.
+template<class T, size_t N>
+class SmallVector {
+  static_assert(std::is_trivially_copyable_v<T>, "SmallVector copies elements with memcpy");
+
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  SmallVector() = default;
+
+  explicit SmallVector(size_t count, const T &value = T()) {
+    assign(count, value);
+  }
+
+  template<class It, class = std::enable_if_t<!std::is_integral_v<It>>>
+  SmallVector(It first, It last) {
+    assign(first, last);
+  }
+
+  SmallVector(std::initializer_list<T> values) {
+    assign(values.begin(), values.end());
+  }
+
+  SmallVector(const SmallVector &other) {
+    assign(other.begin(), other.end());
+  }
+
+  SmallVector(SmallVector &&other) noexcept {
+    take(other);
+  }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this != &other)
+      assign(other.begin(), other.end());
+    return *this;
+  }
+
+  SmallVector &operator=(SmallVector &&other) noexcept {
+    if (this != &other) {
+      release();
+      take(other);
+    }
+    return *this;
+  }
+
+  ~SmallVector() {
+    release();
+  }
+
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] size_t capacity() const { return capacity_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+  [[nodiscard]] bool is_inline() const { return data_ == inline_; }
+
+  T *data() { return data_; }
+  const T *data() const { return data_; }
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  T &operator[](size_t i) { return data_[i]; }
+  const T &operator[](size_t i) const { return data_[i]; }
+  T &front() { return data_[0]; }
+  const T &front() const { return data_[0]; }
+  T &back() { return data_[size_ - 1]; }
+  const T &back() const { return data_[size_ - 1]; }
+
+  void reserve(size_t wanted) {
+    if (wanted <= capacity_)
+      return;
+    T *grown = static_cast<T *>(::operator new(wanted * sizeof(T)));
+    if (size_)
+      std::memcpy(grown, data_, size_ * sizeof(T));
+    release();
+    data_ = grown;
+    capacity_ = wanted;
+  }
+
+  void resize(size_t count, const T &value = T()) {
+    if (count > capacity_)
+      reserve(std::max(count, 2 * capacity_));
+    std::fill(data_ + std::min(size_, count), data_ + count, value);
+    size_ = count;
+  }
+
+  void assign(size_t count, const T &value) {
+    size_ = 0;
+    resize(count, value);
+  }
+
+  template<class It, class = std::enable_if_t<!std::is_integral_v<It>>>
+  void assign(It first, It last) {
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    size_ = 0;
+    reserve(count);
+    std::copy(first, last, data_);
+    size_ = count;
+  }
+
+  void push_back(const T &value) {
+    if (size_ == capacity_)
+      reserve(2 * capacity_);
+    data_[size_++] = value;
+  }
+
+  template<class... Args>
+  T &emplace_back(Args &&...args) {
+    push_back(T(std::forward<Args>(args)...));
+    return back();
+  }
+
+  void pop_back() { --size_; }
+  void clear() { size_ = 0; }
+
+  void swap(SmallVector &other) noexcept {
+    SmallVector temp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(temp);
+  }
+
+  friend bool operator==(const SmallVector &a, const SmallVector &b) {
+    return a.size_ == b.size_ && std::equal(a.begin(), a.end(), b.begin());
+  }
+
+  friend bool operator!=(const SmallVector &a, const SmallVector &b) {
+    return !(a == b);
+  }
+
+ private:
+  T *data_ = inline_;
+  size_t size_ = 0, capacity_ = N;
+  T inline_[N];
+
+  void release() {
+    if (data_ != inline_)
+      ::operator delete(data_);
+    data_ = inline_;
+    capacity_ = N;
+  }
+
+  // Steals other's heap block, or copies its inline elements; other is left empty.
+  void take(SmallVector &other) {
+    if (other.data_ == other.inline_) {
+      std::memcpy(inline_, other.inline_, other.size_ * sizeof(T));
+      data_ = inline_;
+      capacity_ = N;
+    } else {
+      data_ = other.data_;
+      capacity_ = other.capacity_;
+      other.data_ = other.inline_;
+      other.capacity_ = N;
+    }
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+};
 
 class BigInteger {
+ public:
+  using limb = uint32_t;
+  using double_limb = uint64_t;
+  static constexpr int limb_bits = 32;
+  // Eight limbs hold any value below 2^256 (77 decimal digits) without a heap allocation.
+  using limb_vector = SmallVector<limb, 8>;
+
  private:
-  std::vector<int> digits;
+  // Magnitude in base 2^32, least significant limb first, no leading zero limbs; zero is empty.
+  // base is only the radix the number was read in and is printed in by default.
+  limb_vector limbs;
   int base;
   int sign;
+  // Operand sizes in limbs (of the shorter operand) at which multiplication switches algorithm:
+  // schoolbook below karatsuba_threshold, then Karatsuba, Toom-3 and NTT. Defaults from bench.cpp calibrate.
+  inline static size_t karatsuba_threshold = 32;
+  inline static size_t toom3_threshold = 512;
+  inline static size_t ntt_threshold = 5000;
+  // Divisor sizes in limbs at which division switches algorithm: Knuth's algorithm D below
+  // burnikel_ziegler_threshold, then Burnikel-Ziegler recursion. From newton_division_threshold on, a
+  // quotient of three or more divisor-sized blocks shares one Newton reciprocal instead.
+  inline static size_t burnikel_ziegler_threshold = 100;
+  inline static size_t newton_division_threshold = 16384;
+  static constexpr size_t reciprocal_leaf_limbs = 32;
+  // Opt-in parallel multiplication: products whose shorter operand has at least
+  // parallel_threshold limbs split their independent subproducts over parallel_pool.
+  inline static std::unique_ptr<ThreadPool> parallel_pool;
+  inline static size_t parallel_threshold = 4096;
   void trim() {
-    while (digits.size() > 1 && digits.back() == 0)
-      digits.pop_back();
-    if (digits.size() == 1 && digits[0] == 0)
+    normalize(limbs);
+    if (limbs.empty())
       sign = 1;
   }
 
-  static bool abs_less(const BigInteger &a, const BigInteger &b) {
-    if (a.digits.size() != b.digits.size())
-      return a.digits.size() < b.digits.size();
-    for (int i = a.digits.size() - 1; i >= 0; --i) {
-      if (a.digits[i] != b.digits[i])
-        return a.digits[i] < b.digits[i];
+  static void normalize(limb_vector &a) {
+    while (!a.empty() && a.back() == 0)
+      a.pop_back();
+  }
+
+  static int compare_abs(const limb_vector &a, const limb_vector &b) {
+    if (a.size() != b.size())
+      return a.size() < b.size() ? -1 : 1;
+    return LimbKernels::active().compare(a.data(), b.data(), a.size());
+  }
+
+  static bool abs_less(const BigInteger &a, const BigInteger &b) {
+    return compare_abs(a.limbs, b.limbs) < 0;
+  }
+
+  void add_abs(const BigInteger &other) {
+    add_vectors(limbs, other.limbs);
+  }
+
+  void sub_abs(const BigInteger &other) {
+    sub_vectors(limbs, other.limbs);
+    trim();
+  }
+
+  // *this += other_sign * |other| in place.
+  BigInteger &add_signed(const BigInteger &other, int other_sign) {
+    if (sign == other_sign) {
+      add_abs(other);
+    } else if (abs_less(*this, other)) {
+      rsub_vectors(limbs, other.limbs);
+      sign = other_sign;
+    } else {
+      sub_abs(other);
+    }
+    return *this;
+  }
+
+  void mul_small(limb v) {
+    double_limb carry = 0;
+    for (auto &x : limbs) {
+      double_limb product = static_cast<double_limb>(x) * v + carry;
+      x = static_cast<limb>(product);
+      carry = product >> limb_bits;
+    }
+    if (carry)
+      limbs.push_back(static_cast<limb>(carry));
+    normalize(limbs);
+  }
+
+  void add_small(limb v) {
+    for (size_t i = 0; v; ++i) {
+      if (i == limbs.size())
+        limbs.push_back(0);
+      double_limb sum = static_cast<double_limb>(limbs[i]) + v;
+      limbs[i] = static_cast<limb>(sum);
+      v = static_cast<limb>(sum >> limb_bits);
+    }
+  }
+
+  limb div_small(limb v) {
+    return div_small(LimbDivisor(v));
+  }
+
+  // Same, with the reciprocal of the divisor computed once by the caller.
+  limb div_small(const LimbDivisor &divisor) {
+    limb rem = divisor.divide(limbs.data(), limbs.size());
+    trim();
+    return rem;
+  }
+
+  // a[0..n) += b[0..m), m <= n; returns the carry out of a[n - 1].
+  static limb add_into(limb *a, size_t n, const limb *b, size_t m) {
+    limb carry = LimbKernels::active().add(a, a, b, m, 0);
+    size_t i = m;
+    for (; carry && i < n; ++i) {
+      a[i] += 1;
+      carry = a[i] == 0;
+    }
+    return static_cast<limb>(carry);
+  }
+
+  // a[0..n) -= b[0..m), m <= n; returns the borrow out of a[n - 1].
+  static limb sub_into(limb *a, size_t n, const limb *b, size_t m) {
+    limb borrow = LimbKernels::active().sub(a, a, b, m, 0);
+    size_t i = m;
+    for (; borrow && i < n; ++i) {
+      borrow = a[i] == 0;
+      a[i] -= 1;
+    }
+    return borrow;
+  }
+
+  // r[0..n + m) = a[0..n) * b[0..m).
+  static void mul_basecase(limb *r, const limb *a, size_t n, const limb *b, size_t m) {
+    std::fill(r, r + n + m, 0);
+    for (size_t i = 0; i < n; ++i) {
+      double_limb carry = 0;
+      for (size_t j = 0; j < m; ++j) {
+        double_limb product = static_cast<double_limb>(a[i]) * b[j] + r[i + j] + carry;
+        r[i + j] = static_cast<limb>(product);
+        carry = product >> limb_bits;
+      }
+      r[i + m] = static_cast<limb>(carry);
+    }
+  }
+
+  // Limbs of scratch karatsuba_mul needs for an n by m product; mirrors its recursion.
+  static size_t karatsuba_scratch(size_t n, size_t m) {
+    if (n < m)
+      std::swap(n, m);
+    if (m < karatsuba_threshold)
+      return 0;
+    if (n >= 2 * m)
+      return 2 * m + std::max(karatsuba_scratch(m, m), karatsuba_scratch(m, n % m));
+    size_t k = n / 2, n1 = n - k, m1 = m - k;
+    size_t s_len = n1 + 1, t_len = std::max(k, m1) + 1;
+    return std::max({karatsuba_scratch(k, k), karatsuba_scratch(n1, m1),
+                     2 * (s_len + t_len) + karatsuba_scratch(s_len, t_len)});
+  }
+
+  // r[0..n + m) = a[0..n) * b[0..m); all temporaries live in scratch.
+  static void karatsuba_mul(limb *r, const limb *a, size_t n, const limb *b, size_t m, limb *scratch) {
+    if (n < m) {
+      std::swap(a, b);
+      std::swap(n, m);
+    }
+    if (m < karatsuba_threshold) {
+      mul_basecase(r, a, n, b, m);
+      return;
+    }
+
+    if (n >= 2 * m) {
+      // Unbalanced: multiply b by m-limb blocks of a.
+      limb *block = scratch;
+      std::fill(r, r + n + m, 0);
+      for (size_t offset = 0; offset < n; offset += m) {
+        size_t len = std::min(m, n - offset);
+        karatsuba_mul(block, b, m, a + offset, len, scratch + 2 * m);
+        add_into(r + offset, n + m - offset, block, m + len);
+      }
+      return;
+    }
+
+    size_t k = n / 2, n1 = n - k, m1 = m - k;
+    const limb *a1 = a, *a2 = a + k;
+    const limb *b1 = b, *b2 = b + k;
+
+    karatsuba_mul(r, a1, k, b1, k, scratch);
+    karatsuba_mul(r + 2 * k, a2, n1, b2, m1, scratch);
+
+    size_t s_len = n1 + 1, t_len = std::max(k, m1) + 1;
+    limb *s = scratch, *t = s + s_len, *z1 = t + t_len;
+    std::copy(a2, a2 + n1, s);
+    s[n1] = add_into(s, n1, a1, k);
+    if (m1 >= k) {
+      std::copy(b2, b2 + m1, t);
+      t[m1] = add_into(t, m1, b1, k);
+    } else {
+      std::copy(b1, b1 + k, t);
+      t[k] = add_into(t, k, b2, m1);
+    }
+
+    size_t z1_len = s_len + t_len;
+    karatsuba_mul(z1, s, s_len, t, t_len, z1 + z1_len);
+    sub_into(z1, z1_len, r, 2 * k);
+    sub_into(z1, z1_len, r + 2 * k, n1 + m1);
+    add_into(r + k, n + m - k, z1, std::min(z1_len, n + m - k));
+  }
+
+  static bool run_in_parallel(size_t limbs_count) {
+    return parallel_pool && limbs_count >= parallel_threshold;
+  }
+
+  static void run_tasks(std::vector<std::function<void()>> &tasks, bool parallel) {
+    if (parallel) {
+      parallel_pool->run_all(tasks);
+    } else {
+      for (auto &task : tasks)
+        task();
+    }
+  }
+
+  // Top Karatsuba level with its three subproducts run concurrently; they recurse through multiply_limbs.
+  static limb_vector karatsubaParallel(const limb_vector &a, const limb_vector &b) {
+    size_t k = a.size() / 2;
+    limb_vector a1(a.begin(), a.begin() + static_cast<long>(k)), a2(a.begin() + static_cast<long>(k), a.end());
+    limb_vector b1(b.begin(), b.begin() + static_cast<long>(k)), b2(b.begin() + static_cast<long>(k), b.end());
+    normalize(a1);
+    normalize(b1);
+    limb_vector s = a1, t = b1;
+    add_vectors(s, a2);
+    add_vectors(t, b2);
+
+    limb_vector z0, z1, z2;
+    std::vector<std::function<void()>> tasks{
+        [&] { z1 = multiply_limbs(s, t); },
+        [&] { z0 = multiply_limbs(a1, b1); },
+        [&] { z2 = multiply_limbs(a2, b2); }};
+    run_tasks(tasks, true);
+
+    sub_vectors(z1, z0);
+    sub_vectors(z1, z2);
+    limb_vector res = std::move(z0);
+    add_vectors(res, z1, k);
+    add_vectors(res, z2, 2 * k);
+    normalize(res);
+    return res;
+  }
+
+  static limb_vector karatsubaMultiply(const limb_vector &a, const limb_vector &b) {
+    if (a.empty() || b.empty())
+      return {};
+    if (a.size() >= b.size() && a.size() < 2 * b.size() && run_in_parallel(b.size()))
+      return karatsubaParallel(a, b);
+
+    thread_local limb_vector scratch;
+    size_t need = karatsuba_scratch(a.size(), b.size());
+    if (scratch.size() < need)
+      scratch.resize(need);
+
+    limb_vector res(a.size() + b.size());
+    karatsuba_mul(res.data(), a.data(), a.size(), b.data(), b.size(), scratch.data());
+    normalize(res);
+    return res;
+  }
+
+  static BigInteger from_limbs(const limb *p, size_t len) {
+    BigInteger result;
+    result.limbs.assign(p, p + len);
+    result.trim();
+    return result;
+  }
+
+  // Toom-3 (Bodrato's interpolation sequence) on points 0, 1, -1, -2, infinity.
+  // Expects a.size() >= b.size() > a.size() / 2; the five products recurse through multiply_limbs.
+  static limb_vector toom3Multiply(const limb_vector &a, const limb_vector &b) {
+    size_t k = (a.size() + 2) / 3;
+    auto part = [k](const limb_vector &x, size_t i) {
+      size_t lo = std::min(x.size(), i * k);
+      size_t hi = i == 2 ? x.size() : std::min(x.size(), lo + k);
+      return from_limbs(x.data() + lo, hi - lo);
+    };
+
+    BigInteger a0 = part(a, 0), a1 = part(a, 1), a2 = part(a, 2);
+    BigInteger b0 = part(b, 0), b1 = part(b, 1), b2 = part(b, 2);
+
+    BigInteger p = a0 + a2, q = b0 + b2;
+    BigInteger pa1 = p + a1, pam1 = p - a1;
+    BigInteger qb1 = q + b1, qbm1 = q - b1;
+    BigInteger pam2 = (pam1 + a2) * BigInteger(2) - a0;
+    BigInteger qbm2 = (qbm1 + b2) * BigInteger(2) - b0;
+
+    BigInteger r0, r1, rm1, rm2, r4;
+    std::vector<std::function<void()>> tasks{
+        [&] { r0 = a0 * b0; },
+        [&] { r1 = pa1 * qb1; },
+        [&] { rm1 = pam1 * qbm1; },
+        [&] { rm2 = pam2 * qbm2; },
+        [&] { r4 = a2 * b2; }};
+    run_tasks(tasks, run_in_parallel(b.size()));
+
+    BigInteger r3 = rm2 - r1;
+    r3.div_small(3);
+    r1 = r1 - rm1;
+    r1.div_small(2);
+    BigInteger r2 = rm1 - r0;
+    r3 = r2 - r3;
+    r3.div_small(2);
+    r3 = r3 + r4 * BigInteger(2);
+    r2 = r2 + r1 - r4;
+    r1 = r1 - r3;
+
+    limb_vector res = std::move(r0.limbs);
+    add_vectors(res, r1.limbs, k);
+    add_vectors(res, r2.limbs, 2 * k);
+    add_vectors(res, r3.limbs, 3 * k);
+    add_vectors(res, r4.limbs, 4 * k);
+    normalize(res);
+    return res;
+  }
+
+  static constexpr uint32_t ntt_prime1 = 998244353, ntt_prime2 = 469762049;
+  static constexpr uint32_t ntt_generator = 3;
+  // Largest transform both primes support: 998244353 - 1 = 119 * 2^23.
+  static constexpr size_t ntt_max_length = size_t(1) << 23;
+
+  template<uint32_t mod>
+  static uint32_t pow_mod(uint32_t x, uint64_t e) {
+    uint64_t result = 1, power = x;
+    for (; e; e >>= 1) {
+      if (e & 1)
+        result = result * power % mod;
+      power = power * power % mod;
+    }
+    return static_cast<uint32_t>(result);
+  }
+
+  template<uint32_t mod>
+  static void ntt(std::vector<uint32_t> &a, bool invert) {
+    const size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+      size_t bit = n >> 1;
+      for (; j & bit; bit >>= 1)
+        j ^= bit;
+      j ^= bit;
+      if (i < j)
+        std::swap(a[i], a[j]);
+    }
+
+    std::vector<uint32_t> twiddles(n / 2);
+    for (size_t len = 2; len <= n; len <<= 1) {
+      uint32_t w = pow_mod<mod>(ntt_generator, (mod - 1) / len);
+      if (invert)
+        w = pow_mod<mod>(w, mod - 2);
+      size_t half = len / 2;
+      twiddles[0] = 1;
+      for (size_t j = 1; j < half; ++j)
+        twiddles[j] = static_cast<uint32_t>(static_cast<uint64_t>(twiddles[j - 1]) * w % mod);
+      for (size_t i = 0; i < n; i += len) {
+        for (size_t j = 0; j < half; ++j) {
+          uint32_t u = a[i + j];
+          uint32_t v = static_cast<uint32_t>(static_cast<uint64_t>(a[i + j + half]) * twiddles[j] % mod);
+          a[i + j] = u + v >= mod ? u + v - mod : u + v;
+          a[i + j + half] = u >= v ? u - v : u + mod - v;
+        }
+      }
+    }
+
+    if (invert) {
+      uint64_t n_inv = pow_mod<mod>(static_cast<uint32_t>(n % mod), mod - 2);
+      for (auto &x : a)
+        x = static_cast<uint32_t>(x * n_inv % mod);
     }
-    return false;
   }
 
-  void add_abs(const BigInteger &other) {
-    int carry = 0;
-    size_t n = std::max(digits.size(), other.digits.size());
-    digits.resize(n, 0);
-    for (size_t i = 0; i < n || carry; ++i) {
-      if (i >= digits.size())
-        digits.push_back(0);
-      int other_digit = (i < other.digits.size()) ? other.digits[i] : 0;
-      long long sum = static_cast<long long>(digits[i]) + other_digit + carry;
-      carry = (sum >= base) ? 1 : 0;
-      digits[i] = static_cast<int>(sum % base);
+  // Cyclic convolution of 16-bit digit sequences modulo one prime.
+  template<uint32_t mod>
+  static std::vector<uint32_t> ntt_convolve(const std::vector<uint32_t> &x, const std::vector<uint32_t> &y, size_t size,
+                                            bool parallel) {
+    std::vector<uint32_t> fx(x), fy(y);
+    fx.resize(size, 0);
+    fy.resize(size, 0);
+    std::vector<std::function<void()>> tasks{[&] { ntt<mod>(fx, false); }, [&] { ntt<mod>(fy, false); }};
+    run_tasks(tasks, parallel);
+    for (size_t i = 0; i < size; ++i)
+      fx[i] = static_cast<uint32_t>(static_cast<uint64_t>(fx[i]) * fy[i] % mod);
+    ntt<mod>(fx, true);
+    return fx;
+  }
+
+  static std::vector<uint32_t> split_half_limbs(const limb_vector &a) {
+    std::vector<uint32_t> halves(2 * a.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+      halves[2 * i] = a[i] & 0xFFFF;
+      halves[2 * i + 1] = a[i] >> 16;
     }
+    return halves;
   }
 
-  void sub_abs(const BigInteger &other) {
-    int carry = 0;
-    for (size_t i = 0; i < other.digits.size() || carry; ++i) {
-      long long diff = static_cast<long long>(digits[i]) - ((i < other.digits.size()) ? other.digits[i] : 0) - carry;
-      carry = 0;
-      if (diff < 0) {
-        carry = 1;
-        diff += base;
+  // Exact product through NTTs modulo two primes and CRT. Operands are split into 16-bit digits so
+  // every convolution term (< 2^22 * 2^32) stays below ntt_prime1 * ntt_prime2.
+  static limb_vector nttMultiply(const limb_vector &a, const limb_vector &b) {
+    std::vector<uint32_t> x = split_half_limbs(a), y = split_half_limbs(b);
+    size_t terms = x.size() + y.size() - 1;
+    size_t size = 1;
+    while (size < terms)
+      size <<= 1;
+
+    bool parallel = run_in_parallel(std::min(a.size(), b.size()));
+    std::vector<uint32_t> c1, c2;
+    std::vector<std::function<void()>> tasks{
+        [&] { c1 = ntt_convolve<ntt_prime1>(x, y, size, parallel); },
+        [&] { c2 = ntt_convolve<ntt_prime2>(x, y, size, parallel); }};
+    run_tasks(tasks, parallel);
+
+    const uint64_t p1_inv = pow_mod<ntt_prime2>(ntt_prime1 % ntt_prime2, ntt_prime2 - 2);
+    limb_vector res(a.size() + b.size(), 0);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < 2 * res.size(); ++i) {
+      if (i < terms) {
+        uint64_t r1 = c1[i], r2 = c2[i];
+        uint64_t t = (r2 + ntt_prime2 - r1 % ntt_prime2) % ntt_prime2 * p1_inv % ntt_prime2;
+        carry += r1 + t * ntt_prime1;
       }
-      digits[i] = static_cast<int>(diff);
+      res[i / 2] |= static_cast<limb>(carry & 0xFFFF) << (16 * (i % 2));
+      carry >>= 16;
     }
-    trim();
+    normalize(res);
+    return res;
   }
 
-  void mul_small(int v) {
-    if (v < 0) {
-      sign = -sign;
-      v = -v;
+  // Picks the multiplication algorithm by operand size.
+  static limb_vector multiply_limbs(const limb_vector &a, const limb_vector &b) {
+    if (a.size() < b.size())
+      return multiply_limbs(b, a);
+    size_t n = a.size(), m = b.size();
+    if (m < toom3_threshold)
+      return karatsubaMultiply(a, b);
+    if (m >= ntt_threshold && 2 * (n + m) <= ntt_max_length)
+      return nttMultiply(a, b);
+    if (n < 2 * m)
+      return toom3Multiply(a, b);
+
+    limb_vector res(n + m, 0);
+    for (size_t offset = 0; offset < n; offset += m) {
+      size_t len = std::min(m, n - offset);
+      limb_vector block(a.begin() + static_cast<long>(offset), a.begin() + static_cast<long>(offset + len));
+      normalize(block);
+      add_vectors(res, multiply_limbs(block, b), offset);
     }
-    long long carry = 0;
-    for (size_t i = 0; i < digits.size() || carry; ++i) {
-      if (i == digits.size())
-        digits.push_back(0);
-      long long product = static_cast<long long>(digits[i]) * v + carry;
-      digits[i] = static_cast<int>(product % base);
-      carry = product / base;
+    normalize(res);
+    return res;
+  }
+
+  static void add_vectors(limb_vector &a, const limb_vector &b, size_t shift = 0) {
+    if (a.size() < b.size() + shift)
+      a.resize(b.size() + shift, 0);
+    double_limb carry = LimbKernels::active().add(a.data() + shift, a.data() + shift, b.data(), b.size(), 0);
+    for (size_t i = b.size() + shift; carry; ++i) {
+      if (i == a.size())
+        a.push_back(0);
+      double_limb sum = static_cast<double_limb>(a[i]) + carry;
+      a[i] = static_cast<limb>(sum);
+      carry = sum >> limb_bits;
     }
-    trim();
   }
 
-  int div_small(int v) {
-    if (v == 0)
-      throw std::invalid_argument("Division by zero");
+  // a = b - a; requires b >= a.
+  static void rsub_vectors(limb_vector &a, const limb_vector &b) {
+    a.resize(b.size(), 0);
+    LimbKernels::active().sub(a.data(), b.data(), a.data(), b.size(), 0);
+    normalize(a);
+  }
 
-    int original_sign = sign;
-    if ((v < 0 && sign > 0) || (v > 0 && sign < 0))
-      sign = -sign;
+  // Requires a >= b.
+  static void sub_vectors(limb_vector &a, const limb_vector &b) {
+    sub_into(a.data(), a.size(), b.data(), b.size());
+    normalize(a);
+  }
 
-    v = std::abs(v);
-    long long rem = 0;
-    for (int i = static_cast<int>(digits.size()) - 1; i >= 0; --i) {
-      long long current = rem * static_cast<long long>(base) + digits[i];
-      digits[i] = static_cast<int>(current / v);
-      rem = current % v;
+  // Picks the division algorithm by divisor size. Requires |u| >= |v| > 0, both normalized.
+  static void divmod_abs(const limb_vector &u, const limb_vector &v, limb_vector &q, limb_vector &r) {
+    size_t n = v.size(), m = u.size() - n;
+    bool newton = n >= newton_division_threshold && m >= 3 * n;
+    if ((!newton && n < burnikel_ziegler_threshold) || m < burnikel_ziegler_threshold) {
+      divmod_knuth(u, v, q, r);
+      return;
     }
-    trim();
-    sign = original_sign;
-    return static_cast<int>(rem);
+    if (m + 2 < n) {
+      divmod_short_quotient(u, v, q, r);
+      return;
+    }
+    divmod_blocks(u, v, q, r, newton);
   }
 
-  std::vector<int> karatsubaMultiply(const std::vector<int> &a, const std::vector<int> &b) const {
-    long n = a.size(), m = b.size();
-    if (n == 0 || m == 0)
-      return {0};
+  // Knuth, TAOCP vol. 2, 4.3.1, algorithm D. Requires |u| >= |v| > 0, both normalized.
+  static void divmod_knuth(const limb_vector &u_in, const limb_vector &v_in,
+                           limb_vector &q, limb_vector &r) {
+    const size_t n = v_in.size();
+    const size_t m = u_in.size() - n;
+    if (n == 1) {
+      q = u_in;
+      r.assign(1, LimbDivisor(v_in[0]).divide(q.data(), q.size()));
+      normalize(q);
+      normalize(r);
+      return;
+    }
+    q.assign(m + 1, 0);
+
+    const int s = __builtin_clz(v_in.back());
+    limb_vector v(n), u(u_in.size() + 1);
+    for (size_t i = n; i-- > 0;)
+      v[i] = (v_in[i] << s) | (s && i ? v_in[i - 1] >> (limb_bits - s) : 0);
+    u[u_in.size()] = s ? u_in.back() >> (limb_bits - s) : 0;
+    for (size_t i = u_in.size(); i-- > 0;)
+      u[i] = (u_in[i] << s) | (s && i ? u_in[i - 1] >> (limb_bits - s) : 0);
+
+    const double_limb v_top = v[n - 1], v_next = v[n - 2];
+    for (size_t j = m + 1; j-- > 0;) {
+      double_limb numerator = (static_cast<double_limb>(u[j + n]) << limb_bits) | u[j + n - 1];
+      double_limb qhat = numerator / v_top;
+      double_limb rhat = numerator % v_top;
+      while ((qhat >> limb_bits) || qhat * v_next > ((rhat << limb_bits) | u[j + n - 2])) {
+        --qhat;
+        rhat += v_top;
+        if (rhat >> limb_bits)
+          break;
+      }
 
-    if (n < 32 || m < 32) {
-      std::vector<int> res(n + m, 0);
+      double_limb carry = 0;
+      int64_t borrow = 0;
       for (size_t i = 0; i < n; ++i) {
-        long long carry = 0;
-        for (size_t j = 0; j < m || carry; ++j) {
-          long long product = static_cast<long long>(res[i + j]) +
-              (static_cast<long long>(a[i]) * (j < m ? b[j] : 0)) +
-              carry;
-          res[i + j] = static_cast<int>(product % base);
-          carry = product / base;
+        double_limb product = qhat * v[i] + carry;
+        carry = product >> limb_bits;
+        int64_t diff = static_cast<int64_t>(u[i + j]) - static_cast<limb>(product) - borrow;
+        u[i + j] = static_cast<limb>(diff);
+        borrow = diff < 0 ? 1 : 0;
+      }
+      int64_t top = static_cast<int64_t>(u[j + n]) - static_cast<int64_t>(carry) - borrow;
+      u[j + n] = static_cast<limb>(top);
+
+      if (top < 0) {
+        --qhat;
+        carry = 0;
+        for (size_t i = 0; i < n; ++i) {
+          double_limb sum = static_cast<double_limb>(u[i + j]) + v[i] + carry;
+          u[i + j] = static_cast<limb>(sum);
+          carry = sum >> limb_bits;
         }
+        u[j + n] += static_cast<limb>(carry);
       }
-      while (!res.empty() && res.back() == 0)
-        res.pop_back();
-      return res;
+      q[j] = static_cast<limb>(qhat);
     }
 
-    long k = std::min(n, m) / 2;
+    r.resize(n);
+    for (size_t i = 0; i < n; ++i)
+      r[i] = (u[i] >> s) | (s ? u[i + 1] << (limb_bits - s) : 0);
+    normalize(q);
+    normalize(r);
+  }
+
+  // x * 2^(32 k).
+  static BigInteger shift_limbs_up(BigInteger x, size_t k) {
+    if (x.is_zero() || k == 0)
+      return x;
+    size_t len = x.limbs.size();
+    x.limbs.resize(len + k, 0);
+    std::memmove(x.limbs.data() + k, x.limbs.data(), len * sizeof(limb));
+    std::fill(x.limbs.data(), x.limbs.data() + k, 0);
+    return x;
+  }
+
+  // Limbs [from, to) of |x| as a non-negative number.
+  static BigInteger limb_range(const BigInteger &x, size_t from, size_t to = SIZE_MAX) {
+    to = std::min(to, x.limbs.size());
+    return from < to ? from_limbs(x.limbs.data() + from, to - from) : BigInteger();
+  }
 
-    std::vector<int> a1(a.begin(), a.begin() + k);
-    std::vector<int> a2(a.begin() + k, a.end());
+  // |x| * 2^s and floor(|x| / 2^s) for 0 <= s < 32.
+  static BigInteger shift_bits_up(const BigInteger &x, int s) {
+    BigInteger result = x.abs();
+    if (s == 0 || result.is_zero())
+      return result;
+    result.limbs.push_back(0);
+    for (size_t i = result.limbs.size(); i-- > 0;)
+      result.limbs[i] = (result.limbs[i] << s) | (i ? result.limbs[i - 1] >> (limb_bits - s) : 0);
+    result.trim();
+    return result;
+  }
 
-    std::vector<int> b1(b.begin(), b.begin() + k);
-    std::vector<int> b2(b.begin() + k, b.end());
+  static BigInteger shift_bits_down(const BigInteger &x, int s) {
+    BigInteger result = x.abs();
+    if (s == 0)
+      return result;
+    size_t len = result.limbs.size();
+    for (size_t i = 0; i < len; ++i)
+      result.limbs[i] = (result.limbs[i] >> s) | (i + 1 < len ? result.limbs[i + 1] << (limb_bits - s) : 0);
+    result.trim();
+    return result;
+  }
 
-    std::vector<int> a1b1 = karatsubaMultiply(a1, b1);
-    std::vector<int> a2b2 = karatsubaMultiply(a2, b2);
+  static BigInteger knuth_quotient(const BigInteger &a, const BigInteger &b, BigInteger &remainder) {
+    BigInteger quotient;
+    if (abs_less(a, b)) {
+      remainder = a;
+      return quotient;
+    }
+    divmod_knuth(a.limbs, b.limbs, quotient.limbs, remainder.limbs);
+    quotient.trim();
+    remainder.trim();
+    return quotient;
+  }
 
-    std::vector<int> a1a2 = a1;
-    add_vectors(a1a2, a2, base);
-    std::vector<int> b1b2 = b1;
-    add_vectors(b1b2, b2, base);
+  // Divides until |remainder| < |b| and 0 <= remainder; quotient starts from an estimate a few units off.
+  static void correct_quotient(BigInteger &quotient, BigInteger &remainder, const BigInteger &b) {
+    while (remainder.sign < 0) {
+      quotient -= one();
+      remainder += b;
+    }
+    while (!abs_less(remainder, b)) {
+      quotient += one();
+      remainder -= b;
+    }
+  }
 
-    std::vector<int> r = karatsubaMultiply(a1a2, b1b2);
+  static const BigInteger &one() {
+    static const BigInteger value(1);
+    return value;
+  }
 
-    sub_vectors(r, a1b1, base);
-    sub_vectors(r, a2b2, base);
+  // Burnikel and Ziegler, "Fast Recursive Division" (1998). a < b * 2^(32 n), b has n limbs and its top
+  // bit set. Halving n down to an odd or small block keeps every step a pair of half-size divisions
+  // plus one half-size multiplication, so the cost follows multiplication times log n.
+  static BigInteger divide_2n1n(const BigInteger &a, const BigInteger &b, size_t n, BigInteger &remainder) {
+    if (n % 2 || n < burnikel_ziegler_threshold)
+      return knuth_quotient(a, b, remainder);
+    size_t half = n / 2;
+    BigInteger middle;
+    BigInteger high = divide_3n2n(limb_range(a, half), b, half, middle);
+    BigInteger low =
+        divide_3n2n(shift_limbs_up(std::move(middle), half) + limb_range(a, 0, half), b, half, remainder);
+    return shift_limbs_up(std::move(high), half) + low;
+  }
 
-    std::vector<int> res(a1b1.size() + 2 * k, 0);
-    add_vectors(res, a1b1, 0);
-    add_vectors(res, r, k);
-    add_vectors(res, a2b2, 2 * k);
+  // a < b * 2^(32 n), b has 2n limbs and its top bit set: the quotient of the top 2n limbs of a by the
+  // top n of b is off by at most two.
+  static BigInteger divide_3n2n(const BigInteger &a, const BigInteger &b, size_t n, BigInteger &remainder) {
+    BigInteger b_high = limb_range(b, n), quotient, partial;
+    if (abs_less(limb_range(a, 2 * n), b_high)) {
+      quotient = divide_2n1n(limb_range(a, n), b_high, n, partial);
+    } else {
+      quotient.limbs.assign(n, ~limb(0));
+      partial = limb_range(a, n) - shift_limbs_up(b_high, n) + b_high;
+    }
+    remainder = shift_limbs_up(std::move(partial), n) + limb_range(a, 0, n) - quotient * limb_range(b, 0, n);
+    correct_quotient(quotient, remainder, b);
+    return quotient;
+  }
 
-    while (!res.empty() && res.back() == 0)
-      res.pop_back();
+  // floor(2^(64 n) / b) - 2^(32 n) to within a few units, for b of n limbs with its top bit set; the
+  // implicit top limb keeps every product at n limbs (see LimbDivisor). Newton's step
+  // x += x (2^(64 n) - b x) / 2^(64 n) doubles the correct limbs of the reciprocal of the top half of b;
+  // two guard limbs on that half keep its error of a few units from growing with each doubling. The
+  // step only needs the top n - high limbs of x and of the error, so the cost follows multiplication.
+  static BigInteger reciprocal(const BigInteger &b, size_t n) {
+    BigInteger remainder;
+    if (n <= reciprocal_leaf_limbs)
+      return knuth_quotient(shift_limbs_up(one(), 2 * n), b, remainder) - shift_limbs_up(one(), n);
+    size_t high = n / 2 + 2, keep = n - high + 3;
+    BigInteger v = shift_limbs_up(reciprocal(limb_range(b, n - high), high), n - high);
+    BigInteger x = shift_limbs_up(one(), n) + v;
+    BigInteger error = shift_limbs_up(one(), 2 * n) - shift_limbs_up(b, n) - b * v;
+    size_t x_drop = x.limbs.size() > keep ? x.limbs.size() - keep : 0;
+    size_t error_drop = error.limbs.size() > keep ? error.limbs.size() - keep : 0;
+    BigInteger step = limb_range(limb_range(x, x_drop) * limb_range(error, error_drop), 2 * n - x_drop - error_drop);
+    if (error.sign < 0)
+      v -= step;
+    else
+      v += step;
+    return v.sign < 0 ? BigInteger() : v;
+  }
 
-    return res;
+  // a < b * 2^(32 n), b has n limbs and its top bit set, v = reciprocal(b, n). The top n limbs of a
+  // times 2^(32 n) + v give the quotient to within a few units.
+  static BigInteger divide_newton(const BigInteger &a, const BigInteger &b, size_t n, const BigInteger &v,
+                                  BigInteger &remainder) {
+    BigInteger a_high = limb_range(a, n);
+    BigInteger quotient = a_high + limb_range(a_high * v, n);
+    remainder = a - quotient * b;
+    correct_quotient(quotient, remainder, b);
+    return quotient;
   }
 
-  static void add_vectors(std::vector<int> &a, const std::vector<int> &b, int base) {
-    long long carry = 0;
-    size_t n = std::max(a.size(), b.size());
-    a.resize(n, 0);
-    for (size_t i = 0; i < b.size() || carry; ++i) {
-      if (i >= a.size())
-        a.push_back(0);
-      int b_digit = (i < b.size()) ? b[i] : 0;
-      long long sum = static_cast<long long>(a[i]) + b_digit + carry;
-      a[i] = static_cast<int>(sum % base);
-      carry = sum / base;
+  // Schoolbook division in blocks of m >= |v| limbs, each block a 2m / m division by Burnikel-Ziegler
+  // recursion or, with newton, by one reciprocal of the shifted divisor shared by all blocks.
+  static void divmod_blocks(const limb_vector &u, const limb_vector &v, limb_vector &q, limb_vector &r, bool newton) {
+    size_t n = v.size(), m = n;
+    if (!newton) {
+      size_t levels = 0;
+      while (((n - 1) >> levels) + 1 > burnikel_ziegler_threshold)
+        ++levels;
+      m = (((n - 1) >> levels) + 1) << levels;
     }
+    int s = __builtin_clz(v.back());
+    BigInteger a = shift_limbs_up(shift_bits_up(from_limbs(u.data(), u.size()), s), m - n);
+    BigInteger b = shift_limbs_up(shift_bits_up(from_limbs(v.data(), v.size()), s), m - n);
+    BigInteger inverse = newton ? reciprocal(b, m) : BigInteger();
+
+    size_t bits = a.limbs.size() * limb_bits - __builtin_clz(a.limbs.back());
+    size_t blocks = std::max<size_t>(2, bits / (m * limb_bits) + 1);
+    BigInteger window = limb_range(a, (blocks - 2) * m), remainder;
+    q.assign((blocks - 1) * m, 0);
+    for (size_t i = blocks - 1; i-- > 0;) {
+      BigInteger digit =
+          newton ? divide_newton(window, b, m, inverse, remainder) : divide_2n1n(window, b, m, remainder);
+      std::copy(digit.limbs.begin(), digit.limbs.end(), q.begin() + static_cast<long>(i * m));
+      if (i)
+        window = shift_limbs_up(std::move(remainder), m) + limb_range(a, (i - 1) * m, i * m);
+    }
+    normalize(q);
+    r = shift_bits_down(limb_range(remainder, m - n), s).limbs;
+  }
+
+  // A quotient of m limbs by a divisor of n > m + 2 limbs only depends on the top limbs: divide the top
+  // 2m + 2 limbs of u by the top m + 2 of v, then correct by at most a few units.
+  static void divmod_short_quotient(const limb_vector &u, const limb_vector &v, limb_vector &q, limb_vector &r) {
+    size_t drop = v.size() - (u.size() - v.size()) - 2;
+    limb_vector q_estimate, r_estimate;
+    divmod_abs(limb_vector(u.begin() + static_cast<long>(drop), u.end()),
+               limb_vector(v.begin() + static_cast<long>(drop), v.end()), q_estimate, r_estimate);
+    BigInteger quotient = from_limbs(q_estimate.data(), q_estimate.size());
+    BigInteger a = from_limbs(u.data(), u.size()), b = from_limbs(v.data(), v.size());
+    BigInteger remainder = a - quotient * b;
+    correct_quotient(quotient, remainder, b);
+    q = std::move(quotient.limbs);
+    r = std::move(remainder.limbs);
+  }
+
+  static BigInteger from_u64(uint64_t value) {
+    BigInteger result;
+    result.limbs = {static_cast<limb>(value), static_cast<limb>(value >> limb_bits)};
+    result.trim();
+    return result;
+  }
+
+  static uint64_t to_u64(const limb_vector &a) {
+    uint64_t value = 0;
+    for (size_t i = a.size(); i-- > 0;)
+      value = (value << limb_bits) | a[i];
+    return value;
+  }
+
+  static uint64_t binary_gcd(uint64_t u, uint64_t v) {
+    if (u == 0 || v == 0)
+      return u | v;
+    int shift = __builtin_ctzll(u | v);
+    u >>= __builtin_ctzll(u);
+    do {
+      v >>= __builtin_ctzll(v);
+      if (u > v)
+        std::swap(u, v);
+      v -= u;
+    } while (v);
+    return u << shift;
   }
 
-  static void sub_vectors(std::vector<int> &a, const std::vector<int> &b, int base) {
-    int carry = 0;
-    for (size_t i = 0; i < b.size() || carry; ++i) {
-      long long diff = static_cast<long long>(a[i]) - ((i < b.size()) ? b[i] : 0) - carry;
-      carry = 0;
-      if (diff < 0) {
-        carry = 1;
-        diff += base;
+  // One Lehmer step on u >= v, u at least three limbs, after CPython's _PyLong_GCD: simulate Euclid
+  // on the leading 62 bits with signed cofactors below 2^31, then apply the cofactor matrix to u and v.
+  // Returns false when the leading bits do not determine a quotient. ua and va, when given, are the
+  // coefficients of the original first operand in u and v and are updated alongside.
+  static bool lehmer_step(limb_vector &u, limb_vector &v, BigInteger *ua, BigInteger *va) {
+    const size_t n = u.size();
+    const int shift = limb_bits - __builtin_clz(u[n - 1]) + 2;
+    auto leading = [&](const limb_vector &w) {
+      unsigned __int128 top = 0;
+      for (size_t i = n; i-- > n - 3;)
+        top = (top << limb_bits) | (i < w.size() ? w[i] : 0);
+      return static_cast<int64_t>(top >> shift);
+    };
+    int64_t x = leading(u), y = leading(v);
+
+    int64_t A = 1, B = 0, C = 0, D = 1;
+    size_t k = 0;
+    for (;; ++k) {
+      if (y == C)
+        break;
+      int64_t q = (x + (A - 1)) / (y - C);
+      int64_t s = B + q * D;
+      int64_t t = x - q * y;
+      if (s > t)
+        break;
+      x = y;
+      y = t;
+      t = A + q * C;
+      A = D;
+      B = C;
+      C = s;
+      D = t;
+    }
+    if (k == 0)
+      return false;
+
+    // k odd: u, v = A*v - B*u, D*u - C*v; k even: u, v = A*u - B*v, D*v - C*u.
+    const bool odd = k & 1;
+    v.resize(n, 0);
+    __int128 c_carry = 0, d_carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+      __int128 ui = u[i], vi = v[i];
+      if (odd) {
+        c_carry += static_cast<__int128>(A) * vi - static_cast<__int128>(B) * ui;
+        d_carry += static_cast<__int128>(D) * ui - static_cast<__int128>(C) * vi;
+      } else {
+        c_carry += static_cast<__int128>(A) * ui - static_cast<__int128>(B) * vi;
+        d_carry += static_cast<__int128>(D) * vi - static_cast<__int128>(C) * ui;
       }
-      a[i] = static_cast<int>(diff);
+      u[i] = static_cast<limb>(c_carry);
+      v[i] = static_cast<limb>(d_carry);
+      c_carry >>= limb_bits;
+      d_carry >>= limb_bits;
     }
-    while (a.size() > 1 && a.back() == 0)
-      a.pop_back();
+    normalize(u);
+    normalize(v);
+
+    if (ua) {
+      BigInteger a_ = from_u64(static_cast<uint64_t>(A)), b_ = from_u64(static_cast<uint64_t>(B));
+      BigInteger c_ = from_u64(static_cast<uint64_t>(C)), d_ = from_u64(static_cast<uint64_t>(D));
+      BigInteger new_ua = odd ? a_ * *va - b_ * *ua : a_ * *ua - b_ * *va;
+      BigInteger new_va = odd ? d_ * *ua - c_ * *va : d_ * *va - c_ * *ua;
+      *ua = std::move(new_ua);
+      *va = std::move(new_va);
+    }
+    return true;
   }
 
- public:
+  // gcd(|a|, |b|) by Lehmer's algorithm down to 64 bits. With x given, also the coefficient of a
+  // in g = x * a + y * b.
+  static BigInteger gcd_impl(const BigInteger &a, const BigInteger &b, BigInteger *x) {
+    limb_vector u = a.limbs, v = b.limbs;
+    BigInteger ua(1), va(0);
+    if (compare_abs(u, v) < 0) {
+      std::swap(u, v);
+      std::swap(ua, va);
+    }
 
-  BigInteger() : digits(1, 0), base(10), sign(1) {}
+    while (u.size() > 2 && !v.empty()) {
+      if (!lehmer_step(u, v, x ? &ua : nullptr, x ? &va : nullptr)) {
+        limb_vector q, r;
+        divmod_abs(u, v, q, r);
+        if (x) {
+          BigInteger next = ua - from_limbs(q.data(), q.size()) * va;
+          ua = std::move(va);
+          va = std::move(next);
+        }
+        u = std::move(v);
+        v = std::move(r);
+      }
+      if (compare_abs(u, v) < 0) {
+        std::swap(u, v);
+        std::swap(ua, va);
+      }
+    }
 
-  BigInteger(int v, int input_base = 10) : digits(), base(input_base), sign(1) {
-    if (v < 0) {
-      sign = -1;
-      v = -v;
+    if (!x) {
+      BigInteger g = v.empty() ? from_limbs(u.data(), u.size()) : from_u64(binary_gcd(to_u64(u), to_u64(v)));
+      g.base = a.base;
+      return g;
     }
-    if (v == 0) {
-      digits.push_back(0);
-    } else {
-      while (v > 0) {
-        digits.push_back(v % base);
-        v /= base;
-      }
+
+    BigInteger g = from_limbs(u.data(), u.size()), w = from_limbs(v.data(), v.size());
+    while (!w.is_zero()) {
+      auto [q, r] = divmod(g, w);
+      BigInteger next = ua - q * va;
+      ua = std::move(va);
+      va = std::move(next);
+      g = std::move(w);
+      w = std::move(r);
     }
+    *x = a.sign < 0 ? -ua : ua;
+    g.base = a.base;
+    return g;
   }
 
-  BigInteger(const std::string &s, int input_base = 10) : digits(), base(input_base), sign(1) {
-    read(s);
+  // Below this many limbs radix conversion falls back to one small division or multiply per digit.
+  static constexpr size_t radix_leaf_limbs = 32;
+
+  // Largest power of digits_base that fits in a limb, and its exponent.
+  static std::pair<limb, size_t> limb_radix(int digits_base) {
+    limb power = static_cast<limb>(digits_base);
+    size_t exponent = 1;
+    while (static_cast<double_limb>(power) * static_cast<limb>(digits_base) <= UINT32_MAX) {
+      power *= static_cast<limb>(digits_base);
+      ++exponent;
+    }
+    return {power, exponent};
   }
 
-  [[nodiscard]] int get_base() const {
-    return base;
+  static BigInteger from_limb(limb value) {
+    BigInteger result;
+    if (value)
+      result.limbs.push_back(value);
+    return result;
   }
 
-  void read(const std::string &sex) {
-    std::string s = sex;
-    int temp_ = 0;
-    for (auto x : s) {
-      s[temp_] = char(toupper(x));
-      temp_++;
+  // powers[i] = new_base^(exponent * 2^i); x < powers[level]^2 and x < new_base^pad when pad != 0.
+  // The leaf peels off new_base^exponent per pass over x and splits that limb into exponent digits.
+  static void to_digits_rec(const BigInteger &x, int level, const std::vector<std::shared_ptr<const BigInteger>> &powers,
+                            size_t exponent, const LimbDivisor &chunk, const LimbDivisor &digit, limb_vector &out,
+                            size_t pad) {
+    if (level < 0 || x.limbs.size() <= radix_leaf_limbs) {
+      size_t start = out.size();
+      BigInteger temp = x;
+      while (!temp.is_zero()) {
+        limb part = temp.div_small(chunk), value;
+        for (size_t i = 0; i < exponent && (part || !temp.is_zero()); ++i) {
+          part = digit.divide(part, value);
+          out.push_back(value);
+        }
+      }
+      if (pad)
+        out.resize(start + pad, 0);
+      return;
     }
-    digits.clear();
-    sign = 1;
-    int pos = 0;
-    if (s[0] == '-') {
-      sign = -1;
-      pos++;
+
+    auto [high, low] = divmod(x, *powers[level]);
+    size_t low_len = exponent << level;
+    to_digits_rec(low, level - 1, powers, exponent, chunk, digit, out, low_len);
+    to_digits_rec(high, level - 1, powers, exponent, chunk, digit, out, pad ? pad - low_len : 0);
+  }
+
+  // values[0..count) are digits of radix, least significant first; powers[i] = radix^(unit * 2^i),
+  // so unit is 1 for limb-sized chunks and the limb_radix exponent for single digits.
+  static BigInteger from_digits_rec(const limb *values, size_t count, int level,
+                                    const std::vector<std::shared_ptr<const BigInteger>> &powers, size_t unit,
+                                    limb radix) {
+    if (count <= unit * radix_leaf_limbs) {
+      BigInteger result;
+      for (size_t i = count; i-- > 0;) {
+        result.mul_small(radix);
+        result.add_small(values[i]);
+      }
+      return result;
     }
-    int f = 0, sum = 0, c = 1;
-    std::vector<int> temp;
 
-    for (int temp_index = static_cast<int>(s.size() - 1); temp_index >= pos; --temp_index) {
-      if (s[temp_index] == ']') {
-        temp.clear();
-        f = 1;
-        continue;
+    while ((unit << level) >= count)
+      --level;
+    size_t low_len = unit << level;
+    BigInteger low = from_digits_rec(values, low_len, level - 1, powers, unit, radix);
+    BigInteger high = from_digits_rec(values + low_len, count - low_len, level - 1, powers, unit, radix);
+    return std::move(high) * *powers[level] + low;
+  }
+
+  // Digits of |this| in new_base, least significant first; zero has no digits.
+  // Divide and conquer: split by new_base^(2^k) powers so the cost follows multiplication and division.
+  [[nodiscard]] limb_vector to_digits(int new_base) const {
+    if (new_base < 2)
+      throw std::invalid_argument("Base must be at least 2");
+    limb_vector result;
+    BigInteger x = this->abs();
+    auto [chunk, exponent] = limb_radix(new_base);
+    std::vector<std::shared_ptr<const BigInteger>> powers(1, power_of(new_base, exponent));
+    if (x.limbs.size() > radix_leaf_limbs) {
+      while (true) {
+        std::shared_ptr<const BigInteger> square = power_of(new_base, exponent << powers.size());
+        if (x < *square)
+          break;
+        powers.push_back(std::move(square));
       }
-      if (s[temp_index] == '[') {
-        f = 0;
+    }
+    to_digits_rec(x, static_cast<int>(powers.size()) - 1, powers, exponent, LimbDivisor(chunk),
+                  LimbDivisor(static_cast<limb>(new_base)), result, 0);
+    while (!result.empty() && result.back() == 0)
+      result.pop_back();
+    return result;
+  }
 
-        for (auto i : temp) {
-          sum += i * c;
-          c *= 10;
-        }
+  // Inverse of to_digits.
+  void assign_digits(const limb_vector &values, int digits_base) {
+    size_t exponent = limb_radix(digits_base).second;
+    std::vector<std::shared_ptr<const BigInteger>> powers = chunk_ladder(digits_base, values.size(), exponent);
+    limbs = from_digits_rec(values.data(), values.size(), static_cast<int>(powers.size()) - 1, powers, exponent,
+                            static_cast<limb>(digits_base)).limbs;
+  }
 
-        if (sum < base) {
-          std::cout << "xz: " << sum << std::endl;
-          digits.push_back(sum);
-          temp.clear();
-          sum = 0;
-          c = 1;
-          continue;
-        } else if (sum < 10){
-          throw std::invalid_argument("Нормальное число вводи блин, давай с 10 хотя бы");
-        } else {
-          throw std::invalid_argument("Digit out of range for the base2");
-        }
+  // power_of(digits_base, exponent * 2^i) until it covers digits digits.
+  static std::vector<std::shared_ptr<const BigInteger>> chunk_ladder(int digits_base, size_t digits, size_t exponent) {
+    std::vector<std::shared_ptr<const BigInteger>> powers(1, power_of(digits_base, exponent));
+    while ((exponent << powers.size()) < digits)
+      powers.push_back(power_of(digits_base, exponent << powers.size()));
+    return powers;
+  }
 
-      }
-      if (f) {
-        temp.push_back(s[temp_index] - '0');
+  // Value of every character as a digit, 0xFF if it can never be one. Letters of either case are
+  // 10..35; other printable characters past 'A' keep the values the old parser gave them
+  // (toupper(c) - 'A' + 10), which only bases above 36 accept. Brackets are handled by read().
+  static constexpr std::array<uint8_t, 256> digit_values = [] {
+    std::array<uint8_t, 256> table{};
+    for (int c = 0; c < 256; ++c) {
+      int upper = c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+      if (c >= '0' && c <= '9')
+        table[c] = static_cast<uint8_t>(c - '0');
+      else if (upper >= 'A' && c < 128 && c != '[' && c != ']')
+        table[c] = static_cast<uint8_t>(upper - 'A' + 10);
+      else
+        table[c] = 0xFF;
+    }
+    return table;
+  }();
+
+  // Throws what the old right-to-left parser reported for the last bad character of s.
+  [[noreturn]] void throw_bad_digit(std::string_view s) const {
+    for (size_t i = s.size(); i-- > 0;) {
+      auto c = static_cast<unsigned char>(s[i]);
+      if (digit_values[c] < base)
         continue;
+      if (c >= '0' && c <= '9')
+        throw std::invalid_argument("Digit out of range for thebase");
+      if (digit_values[c] != 0xFF)
+        throw std::invalid_argument("Digit out of range for the base");
+      break;
+    }
+    throw std::invalid_argument("Invalid character in input string");
+  }
+
+  // True when every character of s is a valid digit below base; the SSE2 path covers bases up to 36.
+  [[nodiscard]] bool all_digits(std::string_view s) const {
+    size_t i = 0;
+#ifdef BIGNUM_X86_KERNELS
+    if (base <= 36) {
+      const __m128i zero_char = _mm_set1_epi8('0'), lower_a = _mm_set1_epi8('a'), case_bit = _mm_set1_epi8(0x20);
+      const __m128i digit_span = _mm_set1_epi8(static_cast<char>(std::min(base, 10) - 1));
+      const __m128i letter_span = _mm_set1_epi8(static_cast<char>(base - 11));
+      for (; i + 16 <= s.size(); i += 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+        __m128i digit = _mm_sub_epi8(c, zero_char);
+        __m128i ok = _mm_cmpeq_epi8(_mm_min_epu8(digit, digit_span), digit);
+        if (base > 10) {
+          __m128i letter = _mm_sub_epi8(_mm_or_si128(c, case_bit), lower_a);
+          ok = _mm_or_si128(ok, _mm_cmpeq_epi8(_mm_min_epu8(letter, letter_span), letter));
+        }
+        if (_mm_movemask_epi8(ok) != 0xFFFF)
+          return false;
       }
-      if (!std::isdigit(s[temp_index])) {
-        if (s[temp_index] - 'A' >= 0) {
-          if (int(s[temp_index] - 'A' + 10) < base) {
-            digits.push_back(int(s[temp_index] - 'A' + 10));
-            continue;
-          } else {
-            throw std::invalid_argument("Digit out of range for the base");
-          }
-        } else {
+    }
+#endif
+    for (; i < s.size(); ++i) {
+      if (digit_values[static_cast<unsigned char>(s[i])] >= base)
+        return false;
+    }
+    return true;
+  }
+
+  // Digits only, most significant first: packed limb_radix-many per limb, then combined by from_digits_rec.
+  void read_plain(std::string_view s) {
+    if (!all_digits(s))
+      throw_bad_digit(s);
+    if ((base & (base - 1)) == 0) {
+      // Power-of-two bases: each digit is a fixed run of bits, so no multiplication is needed.
+      int bits = __builtin_ctz(static_cast<unsigned>(base));
+      limbs.assign((s.size() * bits + limb_bits - 1) / limb_bits, 0);
+      size_t bit = 0;
+      for (size_t i = s.size(); i-- > 0; bit += bits) {
+        limb digit = digit_values[static_cast<unsigned char>(s[i])];
+        size_t at = bit / limb_bits, shift = bit % limb_bits;
+        limbs[at] |= digit << shift;
+        if (shift + bits > limb_bits)
+          limbs[at + 1] |= digit >> (limb_bits - shift);
+      }
+      return;
+    }
+    auto [radix, exponent] = limb_radix(base);
+    size_t count = (s.size() + exponent - 1) / exponent;
+    limb_vector chunks(count);
+    size_t begin = 0;
+    for (size_t k = count; k-- > 0;) {
+      size_t end = s.size() - k * exponent;
+      limb chunk = 0;
+      for (; begin < end; ++begin)
+        chunk = chunk * static_cast<limb>(base) + digit_values[static_cast<unsigned char>(s[begin])];
+      chunks[k] = chunk;
+    }
+    std::vector<std::shared_ptr<const BigInteger>> powers = chunk_ladder(base, s.size(), exponent);
+    limbs = from_digits_rec(chunks.data(), count, static_cast<int>(powers.size()) - 1, powers, 1, radix).limbs;
+  }
+
+  // Digits with "[NN]" groups, read right to left like the old parser so the same error wins.
+  void read_bracketed(std::string_view s) {
+    limb_vector digits;
+    for (size_t i = s.size(); i-- > 0;) {
+      if (s[i] == ']') {
+        size_t open = s.rfind('[', i);
+        if (open == std::string_view::npos)
           throw std::invalid_argument("Invalid character in input string");
+        long long sum = 0;
+        for (size_t j = open + 1; j < i; ++j) {
+          if (s[j] < '0' || s[j] > '9')
+            throw std::invalid_argument("Invalid character in input string");
+          sum = std::min<long long>(sum * 10 + (s[j] - '0'), INT32_MAX);
         }
+        if (sum >= base)
+          throw std::invalid_argument(sum < 10 ? "Нормальное число вводи блин, давай с 10 хотя бы"
+                                               : "Digit out of range for the base2");
+        BIGNUM_LOG(debug, "xz: " << sum);
+        digits.push_back(static_cast<limb>(sum));
+        i = open;
+        continue;
       }
-      int digit = s[temp_index] - '0';
-      if (digit >= base) throw std::invalid_argument("Digit out of range for thebase");
-      digits.push_back(digit);
+      auto c = static_cast<unsigned char>(s[i]);
+      if (digit_values[c] >= base)
+        throw_bad_digit(s.substr(i, 1));
+      digits.push_back(digit_values[c]);
+    }
+    assign_digits(digits, base);
+  }
+
+  struct PowerTable {
+    std::mutex mutex;
+    std::map<std::pair<int, size_t>, std::shared_ptr<const BigInteger>> powers;
+    size_t bytes = 0;
+  };
+
+  static PowerTable &power_table() {
+    static PowerTable table;
+    return table;
+  }
+
+  inline static std::atomic<size_t> power_cache_limit{64 << 20};
+
+  static void append_digit(std::string &out, limb digit) {
+    if (digit < 10)
+      out += static_cast<char>('0' + digit);
+    else if (digit < 36)
+      out += static_cast<char>('A' + (digit - 10));
+    else
+      out += '[' + std::to_string(digit) + ']';
+  }
+
+ public:
+
+  BigInteger() : limbs(), base(10), sign(1) {}
+
+  BigInteger(int v, int input_base = 10) : limbs(), base(input_base), sign(1) {
+    long long value = v;
+    if (value < 0) {
+      sign = -1;
+      value = -value;
+    }
+    if (value != 0)
+      limbs.push_back(static_cast<limb>(value));
+  }
+
+  BigInteger(std::string_view s, int input_base = 10) : limbs(), base(input_base), sign(1) {
+    read(s);
+  }
+
+  [[nodiscard]] int get_base() const {
+    return base;
+  }
+
+  static void set_karatsuba_threshold(size_t limbs_count) {
+    karatsuba_threshold = std::max<size_t>(limbs_count, 4);
+  }
+
+  static void set_toom3_threshold(size_t limbs_count) {
+    toom3_threshold = std::max<size_t>(limbs_count, 16);
+  }
+
+  static void set_ntt_threshold(size_t limbs_count) {
+    ntt_threshold = std::max<size_t>(limbs_count, 1);
+  }
+
+  static void set_burnikel_ziegler_threshold(size_t limbs_count) {
+    burnikel_ziegler_threshold = std::max<size_t>(limbs_count, 8);
+  }
+
+  static void set_newton_division_threshold(size_t limbs_count) {
+    newton_division_threshold = std::max(limbs_count, 2 * reciprocal_leaf_limbs);
+  }
+
+  // threads <= 1 turns parallel multiplication off. Reconfigure only while no multiplication is running.
+  static void set_parallel_multiply(size_t threads, size_t threshold_limbs = 4096) {
+    parallel_pool.reset();
+    if (threads > 1)
+      parallel_pool = std::make_unique<ThreadPool>(threads - 1);
+    parallel_threshold = std::max(threshold_limbs, karatsuba_threshold);
+  }
+
+  // Exact digits_base^k from a process-wide table shared by radix conversion (its base^(k * 2^i)
+  // ladders), pow() and fraction denominators. Missing powers are built by squaring cached halves.
+  // Entries are never evicted, so returned pointers stay valid; past the byte limit new powers are
+  // computed but not kept.
+  static std::shared_ptr<const BigInteger> power_of(int digits_base, size_t k) {
+    if (digits_base < 2)
+      throw std::invalid_argument("Base must be at least 2");
+    PowerTable &table = power_table();
+    {
+      std::lock_guard<std::mutex> lock(table.mutex);
+      auto it = table.powers.find({digits_base, k});
+      if (it != table.powers.end())
+        return it->second;
+    }
+
+    BigInteger value;
+    if (k <= limb_radix(digits_base).second) {
+      value = chunk_power(digits_base, k);
+    } else {
+      std::shared_ptr<const BigInteger> half = power_of(digits_base, k / 2);
+      value = *half * *half;
+      if (k % 2)
+        value.mul_small(static_cast<limb>(digits_base));
+    }
+    value.base = digits_base;
+    auto result = std::make_shared<const BigInteger>(std::move(value));
+
+    size_t bytes = result->limbs.size() * sizeof(limb) + sizeof(BigInteger);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    if (table.bytes + bytes <= power_cache_limit.load(std::memory_order_relaxed)) {
+      auto [it, inserted] = table.powers.emplace(std::make_pair(digits_base, k), result);
+      if (inserted)
+        table.bytes += bytes;
+      else
+        result = it->second;
+    }
+    return result;
+  }
+
+  static void set_power_cache_limit(size_t bytes) {
+    power_cache_limit.store(bytes, std::memory_order_relaxed);
+  }
+
+  // base^exponent; small integer bases are served from the power table.
+  static BigInteger power(const BigInteger &base, size_t exponent) {
+    if (base.sign == 1 && base.limbs.size() == 1 && base.limbs[0] >= 2 && base.limbs[0] <= INT32_MAX) {
+      BigInteger result = *power_of(static_cast<int>(base.limbs[0]), exponent);
+      result.base = base.base;
+      return result;
+    }
+    BigInteger result(1, base.base), square = base;
+    for (; exponent; exponent /= 2) {
+      if (exponent % 2)
+        result *= square;
+      if (exponent > 1)
+        square *= square;
+    }
+    return result;
+  }
+
+  // Number of digits in a string in read() notation: a bracketed group such as "[12]" is one digit.
+  static size_t digit_count(std::string_view s) {
+    size_t count = 0;
+    bool in_group = false;
+    for (char c : s) {
+      if (c == '[')
+        ++count, in_group = true;
+      else if (c == ']')
+        in_group = false;
+      else if (!in_group && c != '-')
+        ++count;
     }
+    return count;
+  }
+
+  // Digits of new_base that fit one limb: the chunk width used by fixed-width expansion.
+  static size_t chunk_width(int digits_base) {
+    return limb_radix(digits_base).second;
+  }
+
+  // digits_base^width for width <= chunk_width(digits_base).
+  static BigInteger chunk_power(int digits_base, size_t width) {
+    limb power = 1;
+    for (size_t i = 0; i < width; ++i)
+      power *= static_cast<limb>(digits_base);
+    return from_limb(power);
+  }
+
+  // Appends 0 <= chunk < digits_base^width as exactly width digits, leading zeros included.
+  static void append_chunk(std::string &out, const BigInteger &chunk, const LimbDivisor &digits_base, size_t width) {
+    limb value = chunk.is_zero() ? 0 : chunk.limbs[0];
+    limb digits[32];
+    for (size_t i = 0; i < width; ++i)
+      value = digits_base.divide(value, digits[i]);
+    for (size_t i = width; i-- > 0;)
+      append_digit(out, digits[i]);
+  }
 
+  // An optional '-', then digits 0-9 and A-Z in either case; digits of 36 and up are written "[NN]".
+  void read(std::string_view s) {
+    if (base < 2)
+      throw std::invalid_argument("Base must be at least 2");
+    sign = 1;
+    if (!s.empty() && s[0] == '-') {
+      sign = -1;
+      s.remove_prefix(1);
+    }
+    if (s.find('[') == std::string_view::npos && s.find(']') == std::string_view::npos)
+      read_plain(s);
+    else
+      read_bracketed(s);
     trim();
   }
 
@@ -299,136 +2165,164 @@ class BigInteger {
     return res;
   }
 
-  BigInteger operator+(const BigInteger &other) const {
+  BigInteger &operator+=(const BigInteger &other) {
+    return add_signed(other, other.sign);
+  }
+
+  BigInteger &operator-=(const BigInteger &other) {
+    return add_signed(other, -other.sign);
+  }
+
+  BigInteger &operator*=(const BigInteger &other) {
+    limbs = multiply_limbs(limbs, other.limbs);
+    sign *= other.sign;
+    trim();
+    return *this;
+  }
+
+  BigInteger &operator/=(const BigInteger &other) {
+    return *this = divmod(*this, other).first;
+  }
+
+  BigInteger &operator%=(const BigInteger &other) {
+    return *this = *this % other;
+  }
+
+  // A temporary left operand lends its storage to the result.
+  BigInteger operator+(const BigInteger &other) && {
+    *this += other;
+    return std::move(*this);
+  }
+
+  BigInteger operator-(const BigInteger &other) && {
+    *this -= other;
+    return std::move(*this);
+  }
+
+  BigInteger operator*(const BigInteger &other) && {
+    *this *= other;
+    return std::move(*this);
+  }
+
+  BigInteger operator+(const BigInteger &other) const & {
 
     BigInteger result;
     result.base = base;
 
     if (sign == other.sign) {
       result.sign = sign;
-      result.digits = digits;
+      result.limbs = limbs;
       result.add_abs(other);
     } else {
       if (abs_less(*this, other)) {
         result.sign = other.sign;
-        result.digits = other.digits;
+        result.limbs = other.limbs;
         result.sub_abs(*this);
       } else {
         result.sign = sign;
-        result.digits = digits;
+        result.limbs = limbs;
         result.sub_abs(other);
       }
     }
     return result;
   }
 
-  BigInteger operator-(const BigInteger &other) const {
-    if (base != other.base)
-      throw std::invalid_argument("Bases must be the same for subtraction");
-
+  BigInteger operator-(const BigInteger &other) const & {
     BigInteger result;
     result.base = base;
 
     if (sign != other.sign) {
       result.sign = sign;
-      result.digits = digits;
+      result.limbs = limbs;
       result.add_abs(other);
     } else {
       if (abs_less(*this, other)) {
         result.sign = -sign;
-        result.digits = other.digits;
+        result.limbs = other.limbs;
         result.sub_abs(*this);
       } else {
         result.sign = sign;
-        result.digits = digits;
+        result.limbs = limbs;
         result.sub_abs(other);
       }
     }
     return result;
   }
 
-  BigInteger operator*(const BigInteger &other) const {
-    if (base != other.base)
-      BigInteger kek = other.convert_to_bigint(base);
-
+  BigInteger operator*(const BigInteger &other) const & {
     BigInteger result;
     result.base = base;
     result.sign = sign * other.sign;
-    result.digits = karatsubaMultiply(digits, other.digits);
-
-    if (result.digits.empty())
-      result.digits.push_back(0);
-
+    result.limbs = multiply_limbs(limbs, other.limbs);
+    result.trim();
     return result;
   }
 
   BigInteger operator%(const BigInteger &other) const {
-    BigInteger result = *this - other * (*this / other);
+    BigInteger result = divmod(*this, other).second;
     result.base = other.base;
     return result;
   }
 
   BigInteger operator/(const BigInteger &other) const {
+    return divmod(*this, other).first;
+  }
 
-    if (base != other.base)
-      throw std::invalid_argument("Bases must be the same for division");
-    if (other.is_zero())
+  // Truncating division: a = q * b + r, |r| < |b|, r has the sign of a.
+  static std::pair<BigInteger, BigInteger> divmod(const BigInteger &a, const BigInteger &b) {
+    if (b.is_zero())
       throw std::invalid_argument("Division by zero");
 
-    BigInteger dividend = this->abs();
-    BigInteger divisor = other.abs();
+    BigInteger quotient(0, a.base);
+    BigInteger remainder(0, a.base);
+    if (abs_less(a, b)) {
+      remainder = a;
+      return {quotient, remainder};
+    }
 
-    BigInteger quotient(0, base);
-    BigInteger left(0, base);
-    BigInteger determinator1(1, base);
-    BigInteger right(dividend.convert_to_string(base), base);
-    right = right + determinator1;
-    quotient.sign = sign * other.sign;
+    divmod_abs(a.limbs, b.limbs, quotient.limbs, remainder.limbs);
+    quotient.sign = a.sign * b.sign;
+    remainder.sign = a.sign;
+    quotient.trim();
+    remainder.trim();
+    return {quotient, remainder};
+  }
 
-    BigInteger remainder = BigInteger(0, base);
+  // Same as divmod(a, b) for b = divisor.value(), reusing the reciprocal across calls.
+  static std::pair<BigInteger, BigInteger> divmod(BigInteger a, const LimbDivisor &divisor) {
+    int sign = a.sign;
+    BigInteger remainder = from_limb(a.div_small(divisor));
+    remainder.base = a.base;
+    if (!remainder.is_zero())
+      remainder.sign = sign;
+    return {std::move(a), std::move(remainder)};
+  }
 
-    while (left + determinator1 < right) {
-      quotient = (left + right);
-      quotient.div_small(2);
-      if (quotient * divisor <= dividend) {
-        left = quotient;
-      } else {
-        right = quotient;
-      }
-      quotient.trim();
-      left.trim();
-      right.trim();
+  // A reciprocal for divmod when |this| is a single nonzero limb.
+  [[nodiscard]] std::optional<LimbDivisor> limb_divisor() const {
+    if (limbs.size() != 1)
+      return std::nullopt;
+    return LimbDivisor(limbs[0]);
+  }
 
-    }
+  // Non-negative greatest common divisor.
+  static BigInteger lehmer_gcd(const BigInteger &a, const BigInteger &b) {
+    return gcd_impl(a, b, nullptr);
+  }
 
-    left.trim();
-    return left;
+  // g = gcd(a, b) >= 0 together with x, y such that a * x + b * y = g.
+  static BigInteger extended_gcd(const BigInteger &a, const BigInteger &b, BigInteger &x, BigInteger &y) {
+    BigInteger g = gcd_impl(a, b, &x);
+    y = b.is_zero() ? BigInteger(0, b.base) : (g - a * x) / b;
+    return g;
   }
 
   bool operator<(const BigInteger &other) const {
-    if (base != other.base)
-      throw std::invalid_argument("Bases must be the same for comparison");
-
     if (sign != other.sign)
       return sign < other.sign;
 
-    if (sign == 1) {
-      if (digits.size() != other.digits.size())
-        return digits.size() < other.digits.size();
-      for (int i = static_cast<int>(digits.size() - 1); i >= 0; --i) {
-        if (digits[i] != other.digits[i])
-          return digits[i] < other.digits[i];
-      }
-      return false;
-    } else {
-      if (digits.size() != other.digits.size())
-        return digits.size() > other.digits.size();
-      for (int i = static_cast<int>(digits.size() - 1); i >= 0; --i) {
-        if (digits[i] != other.digits[i])
-          return digits[i] > other.digits[i];
-      }
-      return false;
-    }
+    int cmp = compare_abs(limbs, other.limbs);
+    return sign == 1 ? cmp < 0 : cmp > 0;
   }
 
   bool operator>(const BigInteger &other) const {
@@ -444,10 +2338,7 @@ class BigInteger {
   }
 
   bool operator==(const BigInteger &other) const {
-    if (base != other.base)
-      BigInteger new_other = other.convert_to_bigint(base);
-
-    return (sign == other.sign) && (digits == other.digits);
+    return (sign == other.sign) && (limbs == other.limbs);
   }
 
   bool operator!=(const BigInteger &other) const {
@@ -455,9 +2346,7 @@ class BigInteger {
   }
 
   bool operator==(const int &other) const {
-    BigInteger temp(other);
-    BigInteger tempy = temp.convert_to_bigint(base);
-    return (*this == tempy);
+    return *this == BigInteger(other);
   }
 
   bool operator!=(const int &other) const {
@@ -471,7 +2360,7 @@ class BigInteger {
   }
 
   [[nodiscard]] bool is_zero() const {
-    return digits.size() == 1 && digits[0] == 0;
+    return limbs.empty();
   }
 
   [[nodiscard]] std::string convert_to_string(int new_base) const {
@@ -479,29 +2368,19 @@ class BigInteger {
     if (is_zero())
       return "0";
 
-    BigInteger temp = this->abs();
+    limb_vector digits = to_digits(new_base);
     std::string result;
-    while (!temp.is_zero()) {
-      int rem = temp.div_small(new_base);
-      if (rem < 10) {
-        result += static_cast<char>('0' + rem);
-      }else if (rem > 36) {
-        std::string i_hate_my_life = to_string(rem);
-        std::reverse(i_hate_my_life.begin(), i_hate_my_life.end());
-        result += (']' + i_hate_my_life + '[');
-      }else {
-        result += static_cast<char>('A' + (rem - 10));
-      }
-    }
     if (sign == -1)
       result += '-';
-
-    std::reverse(result.begin(), result.end());
+    for (size_t i = digits.size(); i-- > 0;)
+      append_digit(result, digits[i]);
     return result;
   }
 
+  // Same value, printed in new_base by default.
   [[nodiscard]] BigInteger convert_to_bigint(int new_base) const {
-    BigInteger temp(this->convert_to_string(new_base), new_base);
+    BigInteger temp = *this;
+    temp.base = new_base;
     return temp;
   }
 
@@ -513,32 +2392,24 @@ class BigInteger {
   }
 
   friend std::ostream &operator<<(std::ostream &out, const BigInteger &number) {
-    if (number.sign == -1)
-      out << '-';
-    if (number.is_zero()) {
-      out << '0';
-      return out;
-    }
-
-    for (int i = static_cast<int>(number.digits.size()) - 1; i >= 0; --i) {
-      if (number.digits[i] > 9 and number.digits[i] <= 35) out << char('A' - 10 + number.digits[i]);
-      else if (number.digits[i] > 35) {
-        out << '[';
-        out << number.digits[i];
-        out << ']';
-      } else out << number.digits[i];
-    }
+    out << number.convert_to_string(number.base);
     return out;
   }
 
   friend int get_len(const BigInteger &number, int cnt = 0){
-    for (auto i : number.digits) cnt++;
-    return cnt;
+    if (number.is_zero())
+      return cnt + 1;
+    return cnt + static_cast<int>(number.to_digits(number.base).size());
   }
 };
 
 BigInteger gcd(const BigInteger &first_number, const BigInteger& second_number) {
-  return (second_number != 0) ? gcd(second_number, first_number % second_number) : first_number;
+  PhaseClock::Scope phase(Phase::gcd);
+  return BigInteger::lehmer_gcd(first_number, second_number);
+}
+
+BigInteger extended_gcd(const BigInteger &first_number, const BigInteger &second_number, BigInteger &x, BigInteger &y) {
+  return BigInteger::extended_gcd(first_number, second_number, x, y);
 }
 
 class BigFraction {
@@ -552,105 +2423,153 @@ class BigFraction {
   BigFraction(const std::string& s, int base, bool period = false) {
     if (!period) {
       BigInteger temp_num(s, base);
-      int cnt = 0;
-      for (auto i : s) if (i == '[' or i == ']') cnt += 1;
-      BigInteger temp_den(static_cast<int>(std::pow(base, get_len(temp_num))), base);
-      std::cout << s << " zozz: " << temp_num << " " << temp_den << " " << get_len(temp_num) + 1 << std::endl;
-      Simplify(temp_num, temp_den);
+      BigInteger temp_den = *BigInteger::power_of(base, BigInteger::digit_count(s));
+      BIGNUM_LOG(debug, s << " zozz: " << temp_num << " " << temp_den << " " << get_len(temp_num) + 1);
+      Simplify(std::move(temp_num), std::move(temp_den));
     }
     base = base;
 
   };
 
   void Simplify(BigInteger temp_num, BigInteger temp_den) {
-    BigInteger nod = gcd(temp_num.convert_to_bigint(10), temp_den.convert_to_bigint(10));
-    nod = nod.convert_to_bigint(temp_num.get_base());
-
-    temp_num = temp_num / nod;
-    temp_den = temp_den / nod;
-    num_ = temp_num;
-    den_ = temp_den;
-    base = temp_num.get_base();
+    std::pair<BigInteger, BigInteger> ans = Get_Simplify(std::move(temp_num), std::move(temp_den));
+    num_ = std::move(ans.first);
+    den_ = std::move(ans.second);
+    base = num_.get_base();
+    reduced_ = true;
   }
 
+  // Works in the operands' own representation; the denominator of the result is positive.
   static std::pair<BigInteger, BigInteger> Get_Simplify(BigInteger temp_num, BigInteger temp_den) {
-    BigInteger nod = gcd(temp_num.convert_to_bigint(10), temp_den.convert_to_bigint(10));
-    nod = nod.convert_to_bigint(temp_num.get_base());
-
-    temp_num = temp_num / nod;
-    temp_den = temp_den / nod;
-    return {temp_num, temp_den};
+    BigInteger nod = gcd(temp_num, temp_den);
+    if (temp_den < 0)
+      nod = -nod;
+    if (nod != 1 && !nod.is_zero()) {
+      temp_num /= nod;
+      temp_den /= nod;
+    }
+    return {std::move(temp_num), std::move(temp_den)};
   }
 
-  BigFraction(BigInteger num, BigInteger den) {
-    Simplify(std::move(num), std::move(den));
+  BigFraction(BigInteger num, BigInteger den) : num_(std::move(num)), den_(std::move(den)) {
+    settle();
   };
 
-  explicit BigFraction(BigInteger num) : num_(std::move(num)) {};
+  explicit BigFraction(BigInteger num) : num_(std::move(num)), den_(1, num_.get_base()) {};
   BigFraction &operator=(const BigFraction &other) = default;
+  BigFraction &operator=(BigFraction &&other) noexcept = default;
   BigFraction(const BigFraction &other) = default;
+  BigFraction(BigFraction &&other) noexcept = default;
 
-  ~BigFraction() {
-    num_ = 1;
-    den_ = 1;
-  };
+  // When enabled, arithmetic results keep their common factors until they are printed or read back.
+  // Reading an unreduced fraction (num(), den(), printing) reduces it in place, so such a fraction
+  // must not be read from several threads at once; call reduce() before sharing it.
+  static void set_lazy_reduction(bool enabled) {
+    lazy_reduction.store(enabled, std::memory_order_relaxed);
+  }
 
-  [[nodiscard]] BigInteger num() const {
+  // What the (num, den) constructor does with its terms: reduce them now, or with lazy reduction
+  // only move the sign to the numerator and leave the reduction to reduce().
+  void settle() {
+    if (lazy_reduction.load(std::memory_order_relaxed)) {
+      if (den_ < 0) {
+        num_ = -num_;
+        den_ = -den_;
+      }
+      base = num_.get_base();
+      reduced_ = false;
+    } else {
+      Simplify(std::move(num_), std::move(den_));
+    }
+  }
+
+  void reduce() const {
+    if (reduced_)
+      return;
+    std::pair<BigInteger, BigInteger> ans = Get_Simplify(num_, den_);
+    num_ = std::move(ans.first);
+    den_ = std::move(ans.second);
+    reduced_ = true;
+  }
+
+  [[nodiscard]] const BigInteger &num() const {
+    reduce();
     return num_;
   }
-  [[nodiscard]] BigInteger den() const {
+  [[nodiscard]] const BigInteger &den() const {
+    reduce();
     return den_;
   }
 
   friend BigFraction operator+(const BigFraction &lhs, const BigFraction &rhs) {
-    BigInteger new_den = (lhs.den_ * rhs.den_) / gcd(lhs.den_, rhs.den_);
-    BigInteger new_num = lhs.num_ * new_den / lhs.den_ + rhs.num_ * new_den / rhs.den_;
-    std::pair<BigInteger, BigInteger> ans = Get_Simplify(new_num, new_den);
-    return {ans.first, ans.second};
+    if (lazy_reduction.load(std::memory_order_relaxed))
+      return {lhs.num_ * rhs.den_ + rhs.num_ * lhs.den_, lhs.den_ * rhs.den_};
+    BigInteger nod = gcd(lhs.den_, rhs.den_);
+    BigInteger lhs_factor = rhs.den_ / nod, rhs_factor = lhs.den_ / nod;
+    return {lhs.num_ * lhs_factor + rhs.num_ * rhs_factor, lhs.den_ * lhs_factor};
   };
 
   friend BigFraction operator-(const BigFraction &lhs, const BigFraction &rhs) {
-    BigInteger new_den = (lhs.den_ * rhs.den_) / gcd(lhs.den_, rhs.den_);
-    BigInteger new_num = lhs.num_ * rhs.den_ - rhs.num_ * lhs.den_;
-    std::pair<BigInteger, BigInteger> ans = Get_Simplify(new_num, new_den);
-    return {ans.first, ans.second};
+    if (lazy_reduction.load(std::memory_order_relaxed))
+      return {lhs.num_ * rhs.den_ - rhs.num_ * lhs.den_, lhs.den_ * rhs.den_};
+    BigInteger nod = gcd(lhs.den_, rhs.den_);
+    BigInteger lhs_factor = rhs.den_ / nod, rhs_factor = lhs.den_ / nod;
+    return {lhs.num_ * lhs_factor - rhs.num_ * rhs_factor, lhs.den_ * lhs_factor};
   };
 
   friend BigFraction operator*(const BigFraction &lhs, const BigFraction &rhs) {
-    BigInteger new_den = lhs.den_ * rhs.den_;
-    BigInteger new_num = lhs.num_ * rhs.num_;
-    std::pair<BigInteger, BigInteger> ans = Get_Simplify(new_num, new_den);
-    return {ans.first, ans.second};
+    return {lhs.num_ * rhs.num_, lhs.den_ * rhs.den_};
+  };
+
+  friend BigFraction operator/(const BigFraction &lhs, const BigFraction &rhs) {
+    return {lhs.num_ * rhs.den_, lhs.den_ * rhs.num_};
   };
 
-  friend BigFraction operator/(const BigFraction &lhs, const BigFraction &rhs) {
-    BigInteger new_rhs_num = rhs.num_, new_rhs_den = rhs.den_;
-    std::swap(new_rhs_num, new_rhs_den);
-    BigInteger new_den = lhs.den_ * new_rhs_den;
-    BigInteger new_num = lhs.num_ * new_rhs_num;
-    std::pair<BigInteger, BigInteger> ans = Get_Simplify(new_num, new_den);
-    return {ans.first, ans.second};
-  };
+  friend BigFraction operator+(BigFraction &&lhs, const BigFraction &rhs) {
+    lhs += rhs;
+    return std::move(lhs);
+  }
+
+  friend BigFraction operator-(BigFraction &&lhs, const BigFraction &rhs) {
+    lhs -= rhs;
+    return std::move(lhs);
+  }
+
+  friend BigFraction operator*(BigFraction &&lhs, const BigFraction &rhs) {
+    lhs *= rhs;
+    return std::move(lhs);
+  }
+
+  friend BigFraction operator/(BigFraction &&lhs, const BigFraction &rhs) {
+    lhs /= rhs;
+    return std::move(lhs);
+  }
+
+  // Sign of lhs - rhs by cross-multiplication; both denominators are positive.
+  static int compare(const BigFraction &lhs, const BigFraction &rhs) {
+    BigInteger left = lhs.num_ * rhs.den_, right = rhs.num_ * lhs.den_;
+    return left < right ? -1 : (right < left ? 1 : 0);
+  }
 
   BigFraction &operator++() {
-    num_ = num_ + den_;
+    num_ += den_;
     return *this;
   };
 
   BigFraction &operator--() {
-    num_ = num_ - den_;
+    num_ -= den_;
     return *this;
   };
 
   BigFraction operator++(const int) {
     BigFraction start = *this;
-    num_ = num_ + den_;
+    num_ += den_;
     return start;
   };
 
   BigFraction operator--(const int) {
     BigFraction start = *this;
-    num_ = num_ - den_;
+    num_ -= den_;
     return start;
   };
 
@@ -688,133 +2607,146 @@ class BigFraction {
   };
 
   friend bool operator>(const BigFraction &lhs, const BigFraction &rhs) {
-    BigFraction temp(lhs - rhs);
-    return temp.num_ * temp.den_ > 0;
+    return compare(lhs, rhs) > 0;
   };
 
   friend bool operator>=(const BigFraction &lhs, const BigFraction &rhs) {
-    BigFraction temp(lhs - rhs);
-    return temp.num_ * temp.den_ >= 0;
+    return compare(lhs, rhs) >= 0;
   };
 
   friend bool operator<(const BigFraction &lhs, const BigFraction &rhs) {
-    BigFraction temp(lhs - rhs);
-    return temp.num_ * temp.den_ < 0;
+    return compare(lhs, rhs) < 0;
   };
 
   friend bool operator<=(const BigFraction &lhs, const BigFraction &rhs) {
-    BigFraction temp(lhs - rhs);
-    return temp.num_ * temp.den_ <= 0;
+    return compare(lhs, rhs) <= 0;
   };
 
   friend bool operator>(const BigFraction &lhs, BigInteger second) {
-    BigFraction temp(lhs - BigFraction(std::move(second)));
-    return temp.num_ * temp.den_ > 0;
+    return compare(lhs, BigFraction(std::move(second))) > 0;
   };
 
   friend bool operator>=(const BigFraction &lhs, BigInteger second) {
-    BigFraction temp(lhs - BigFraction(std::move(second)));
-    return temp.num_ * temp.den_ >= 0;
+    return compare(lhs, BigFraction(std::move(second))) >= 0;
   };
 
   friend bool operator<(const BigFraction &lhs, BigInteger second) {
-    BigFraction temp(lhs - BigFraction(std::move(second)));
-    return temp.num_ * temp.den_ < 0;
+    return compare(lhs, BigFraction(std::move(second))) < 0;
   };
 
   friend bool operator<=(const BigFraction &lhs, BigInteger second) {
-    BigFraction temp(lhs - BigFraction(std::move(second)));
-    return temp.num_ * temp.den_ <= 0;
+    return compare(lhs, BigFraction(std::move(second))) <= 0;
   };
 
   friend bool operator>(BigInteger first, const BigFraction &rhs) {
-    BigFraction temp(BigFraction(std::move(first)) - rhs);
-    return temp.num_ * temp.den_ > 0;
+    return compare(BigFraction(std::move(first)), rhs) > 0;
   };
 
   friend bool operator>=(BigInteger first, const BigFraction &rhs) {
-    BigFraction temp(BigFraction(std::move(first)) - rhs);
-    return temp.num_ * temp.den_ >= 0;
+    return compare(BigFraction(std::move(first)), rhs) >= 0;
   };
 
   friend bool operator<(BigInteger first, const BigFraction &rhs) {
-    BigFraction temp(BigFraction(std::move(first)) - rhs);
-    return temp.num_ * temp.den_ < 0;
+    return compare(BigFraction(std::move(first)), rhs) < 0;
   };
 
   friend bool operator<=(BigInteger first, const BigFraction &rhs) {
-    BigFraction temp(BigFraction(std::move(first)) - rhs);
-    return temp.num_ * temp.den_ <= 0;
+    return compare(BigFraction(std::move(first)), rhs) <= 0;
   };
 
   friend bool operator==(const BigFraction &lhs, const BigFraction &rhs) {
-    BigFraction temp(lhs - rhs);
-    return temp.num_ == 0;
+    return compare(lhs, rhs) == 0;
   };
 
   friend bool operator!=(const BigFraction &lhs, const BigFraction &rhs) {
-    BigFraction temp(lhs - rhs);
-    return temp.num_ != 0;
+    return compare(lhs, rhs) != 0;
   };
 
   friend bool operator==(const BigFraction &lhs, BigInteger second) {
-    BigFraction temp(lhs - BigFraction(std::move(second)));
-    return temp.num_ == 0;
+    return compare(lhs, BigFraction(std::move(second))) == 0;
   };
 
   friend bool operator!=(const BigFraction &lhs, BigInteger second) {
-    BigFraction temp(lhs - BigFraction(std::move(second)));
-    return temp.num_ != 0;
+    return compare(lhs, BigFraction(std::move(second))) != 0;
   };
 
   friend bool operator==(BigInteger first, const BigFraction &rhs) {
-    BigFraction temp(BigFraction(std::move(first)) - rhs);
-    return temp.num_ == 0;
+    return compare(BigFraction(std::move(first)), rhs) == 0;
   };
 
   friend bool operator!=(BigInteger first, const BigFraction &rhs) {
-    BigFraction temp(BigFraction(std::move(first)) - rhs);
-    return temp.num_ != 0;
+    return compare(BigFraction(std::move(first)), rhs) != 0;
   };
 
-  friend BigFraction operator+=(BigFraction &lhs, const BigFraction &rhs) {
-    lhs = lhs + rhs;
+  // The compound operators update lhs's own terms; x op= x works on a copy of the right side.
+  friend BigFraction &operator+=(BigFraction &lhs, const BigFraction &rhs) {
+    if (&lhs == &rhs)
+      return lhs += BigFraction(rhs);
+    if (lazy_reduction.load(std::memory_order_relaxed)) {
+      lhs.num_ *= rhs.den_;
+      lhs.num_ += rhs.num_ * lhs.den_;
+      lhs.den_ *= rhs.den_;
+    } else {
+      BigInteger nod = gcd(lhs.den_, rhs.den_);
+      BigInteger lhs_factor = rhs.den_ / nod;
+      lhs.num_ *= lhs_factor;
+      lhs.num_ += rhs.num_ * (lhs.den_ / nod);
+      lhs.den_ *= lhs_factor;
+    }
+    lhs.settle();
     return lhs;
   }
 
-  friend BigFraction operator-=(BigFraction &lhs, const BigFraction &rhs) {
-    lhs = lhs - rhs;
+  friend BigFraction &operator-=(BigFraction &lhs, const BigFraction &rhs) {
+    if (&lhs == &rhs)
+      return lhs -= BigFraction(rhs);
+    if (lazy_reduction.load(std::memory_order_relaxed)) {
+      lhs.num_ *= rhs.den_;
+      lhs.num_ -= rhs.num_ * lhs.den_;
+      lhs.den_ *= rhs.den_;
+    } else {
+      BigInteger nod = gcd(lhs.den_, rhs.den_);
+      BigInteger lhs_factor = rhs.den_ / nod;
+      lhs.num_ *= lhs_factor;
+      lhs.num_ -= rhs.num_ * (lhs.den_ / nod);
+      lhs.den_ *= lhs_factor;
+    }
+    lhs.settle();
     return lhs;
   }
 
-  friend BigFraction operator*=(BigFraction &lhs, const BigFraction &rhs) {
-    lhs = lhs * rhs;
+  friend BigFraction &operator*=(BigFraction &lhs, const BigFraction &rhs) {
+    if (&lhs == &rhs)
+      return lhs *= BigFraction(rhs);
+    lhs.num_ *= rhs.num_;
+    lhs.den_ *= rhs.den_;
+    lhs.settle();
     return lhs;
   }
 
-  friend BigFraction operator/=(BigFraction &lhs, const BigFraction &rhs) {
-    lhs = lhs / rhs;
+  friend BigFraction &operator/=(BigFraction &lhs, const BigFraction &rhs) {
+    if (&lhs == &rhs)
+      return lhs /= BigFraction(rhs);
+    lhs.num_ *= rhs.den_;
+    lhs.den_ *= rhs.num_;
+    lhs.settle();
     return lhs;
   };
 
-  friend BigFraction operator+=(BigFraction &lhs, BigInteger second) {
-    lhs = (lhs + BigFraction(std::move(second)));
-    return lhs;
+  friend BigFraction &operator+=(BigFraction &lhs, BigInteger second) {
+    return lhs += BigFraction(std::move(second));
   };
 
-  friend BigFraction operator-=(BigFraction &lhs, BigInteger second) {
-    lhs = (lhs - BigFraction(std::move(second)));
-    return lhs;
+  friend BigFraction &operator-=(BigFraction &lhs, BigInteger second) {
+    return lhs -= BigFraction(std::move(second));
   };
 
-  friend BigFraction operator*=(BigFraction &lhs, BigInteger second) {
-    lhs = (lhs * BigFraction(std::move(second)));
-    return lhs;
+  friend BigFraction &operator*=(BigFraction &lhs, BigInteger second) {
+    return lhs *= BigFraction(std::move(second));
   };
 
-  friend BigFraction operator/=(BigFraction &lhs, BigInteger second) {
-    lhs = (lhs / BigFraction(std::move(second)));
-    return lhs;
+  friend BigFraction &operator/=(BigFraction &lhs, BigInteger second) {
+    return lhs /= BigFraction(std::move(second));
   };
 
   friend BigFraction operator+(BigFraction hs) {
@@ -828,154 +2760,193 @@ class BigFraction {
   };
 
   friend std::ostream &operator<<(std::ostream &out, const BigFraction &fract) {
+    fract.reduce();
     out << fract.num_ << "/" << fract.den_;
     return out;
   }
 
   BigFraction convert_to_frac(int aim) {
+    reduce();
     BigFraction Ans = *this;
     Ans.num_ = Ans.num_.convert_to_bigint(aim);
     Ans.den_ = Ans.den_.convert_to_bigint(aim);
     return Ans;
   };
 
-  std::string convert_to_string_full(int new_base = -1) {
-
-    if (new_base == -1)
-      new_base = get_base();
-    if (num_ == 0) return "0";
-    BigInteger num_in_base_10 = num_.convert_to_bigint(10);
-    BigInteger den_in_base_10 = den_.convert_to_bigint(10);
-
-    bool is_negative = false;
-    if ((num_in_base_10 < 0) != (den_in_base_10 < 0)) {
-      is_negative = true;
+  // What digit expansion needs to know about the target base. Build it once and pass it to the
+  // write_string functions when many values go to the same base.
+  struct DigitPlan {
+    explicit DigitPlan(int new_base)
+        : base(new_base), width(BigInteger::chunk_width(checked_base(new_base))), digit_base(new_base),
+          digit_divisor(static_cast<uint32_t>(new_base)) {
+      for (size_t k = 0; k <= width; ++k)
+        powers.push_back(BigInteger::chunk_power(new_base, k));
+      for (int p = 2, rest = new_base; p <= rest; ++p) {
+        size_t exponent = 0;
+        for (; rest % p == 0; rest /= p)
+          ++exponent;
+        if (exponent)
+          primes.emplace_back(BigInteger(p), exponent);
+      }
     }
 
-    if (num_in_base_10 < 0) num_in_base_10 = -num_in_base_10;
-    if (den_in_base_10 < 0) den_in_base_10 = -den_in_base_10;
-
-    BigInteger integer_part = num_in_base_10 / den_in_base_10;
-    BigInteger remainder = num_in_base_10 % den_in_base_10;
-
-    std::string result = integer_part.convert_to_string(get_base());
-
-    if (is_negative && !(integer_part == 0)) {
-      result = "-" + result;
+    static int checked_base(int new_base) {
+      if (new_base < 2)
+        throw std::invalid_argument("Base must be at least 2");
+      return new_base;
     }
 
-    if (remainder != 0) {
-      result += ".";
-      std::vector<std::pair<BigInteger, size_t> > remainder_history;
-
-      std::string fractional_part;
-
-      size_t max_digits = 100000000;
-      size_t position = 0;
-
-      while (remainder != 0 && position < max_digits) {
-        bool found = false;
-        size_t cycle_start = 0;
-        for (auto & i : remainder_history) {
-          if (i.first == remainder) {
-            found = true;
-            cycle_start = i.second;
-            break;
-          }
-        }
-
-        if (found) {
-          fractional_part.insert(cycle_start, "(");
-          fractional_part += ')';
-          break;
-        }
-
-        remainder_history.emplace_back(remainder, fractional_part.size());
-
-        remainder = remainder * new_base;
-
-        BigInteger digit = remainder / den_in_base_10;
-        remainder = remainder % den_in_base_10;
+    int base;
+    size_t width;
+    BigInteger digit_base;
+    LimbDivisor digit_divisor;
+    std::vector<BigInteger> powers;                      // base^0 .. base^width
+    std::vector<std::pair<BigInteger, size_t>> primes;   // prime factors of base with their exponents
+  };
 
-        fractional_part += digit.convert_to_string(new_base);
+  std::string convert_to_string_full(int new_base = -1) {
+    std::string result;
+    size_t period = write_string_full([&result](const std::string &piece) { result += piece; }, new_base);
+    return with_period(std::move(result), period);
+  }
 
-        position++;
-      }
+  std::string convert_to_string(int new_base = -1) {
+    std::string result;
+    size_t period = write_string([&result](const std::string &piece) { result += piece; }, new_base);
+    return with_period(std::move(result), period);
+  }
 
-      result += fractional_part;
+  // Streaming forms of the two conversions: the text goes to sink piece by piece, without the
+  // parentheses. The return value is the offset in the streamed text where the period starts,
+  // or std::string::npos; the period always runs to the end.
+  size_t write_string_full(const std::function<void(const std::string &)> &sink, int new_base = -1,
+                           const DigitPlan *plan = nullptr) {
+    PhaseClock::Scope phase(Phase::format);
+    if (new_base == -1)
+      new_base = get_base();
+    reduce();
+    if (num_ == 0) {
+      sink("0");
+      return std::string::npos;
     }
 
-    return result;
+    std::pair<BigInteger, BigInteger> parts = BigInteger::divmod(num_.abs(), den_);
+    std::string head = parts.first.convert_to_string(get_base());
+    if (num_ < 0)
+      head = "-" + head;
+    if (parts.second == 0) {
+      sink(head);
+      return std::string::npos;
+    }
+    head += '.';
+    sink(head);
+    size_t period = plan && plan->base == new_base ? expand_fraction(parts.second, *plan, 100000000, sink)
+                                                   : expand_fraction(parts.second, DigitPlan(new_base), 100000000, sink);
+    return period == std::string::npos ? period : head.size() + period;
   }
 
-  std::string convert_to_string(int new_base = -1) {
+  size_t write_string(const std::function<void(const std::string &)> &sink, int new_base = -1,
+                      const DigitPlan *plan = nullptr) {
+    PhaseClock::Scope phase(Phase::format);
     if (new_base == -1)
       new_base = get_base();
-
-    if (num_ == 0) return "0";
-    BigInteger num_in_base_10 = num_.convert_to_bigint(10);
-    BigInteger den_in_base_10 = den_.convert_to_bigint(10);
-
-    bool is_negative = false;
-    if ((num_in_base_10 < 0) != (den_in_base_10 < 0)) {
-      is_negative = true;
+    reduce();
+    if (num_ == 0) {
+      sink("0");
+      return std::string::npos;
     }
 
-    if (num_in_base_10 < 0) num_in_base_10 = -num_in_base_10;
-    if (den_in_base_10 < 0) den_in_base_10 = -den_in_base_10;
-
-    BigInteger integer_part = num_in_base_10 / den_in_base_10;
-    BigInteger remainder = num_in_base_10 % den_in_base_10;
-
-    std::string result;
+    std::pair<BigInteger, BigInteger> parts = BigInteger::divmod(num_.abs(), den_);
+    std::string head = num_ < 0 && parts.first != 0 ? "-" : "";
+    if (!head.empty())
+      sink(head);
+    if (parts.second == 0)
+      return std::string::npos;
+    size_t period = plan && plan->base == new_base ? expand_fraction(parts.second, *plan, 10000, sink)
+                                                   : expand_fraction(parts.second, DigitPlan(new_base), 10000, sink);
+    return period == std::string::npos ? period : head.size() + period;
+  }
 
-    if (is_negative && !(integer_part == 0)) {
-      result = "-" + result;
+  static std::string with_period(std::string text, size_t period) {
+    if (period != std::string::npos) {
+      text.insert(period, "(");
+      text += ')';
     }
+    return text;
+  }
 
-    if (remainder != 0) {
-
-      std::vector<std::pair<BigInteger, size_t> > remainder_history;
-
-      std::string fractional_part;
+  // Fractional digits of n / den in new_base that come before the repeating part:
+  // max over primes p of new_base of ceil(v_p(den) / v_p(new_base)).
+  [[nodiscard]] size_t pre_period_length(int new_base) const {
+    return pre_period_length(DigitPlan(new_base));
+  }
 
-      size_t max_digits = 10000;
-      size_t position = 0;
+  [[nodiscard]] size_t pre_period_length(const DigitPlan &plan) const {
+    size_t length = 0;
+    for (const auto &[prime, in_base] : plan.primes) {
+      size_t in_den = 0;
+      BigInteger cofactor = den_;
+      for (auto qr = BigInteger::divmod(cofactor, prime); qr.second.is_zero(); qr = BigInteger::divmod(cofactor, prime)) {
+        cofactor = std::move(qr.first);
+        ++in_den;
+      }
+      length = std::max(length, (in_den + in_base - 1) / in_base);
+    }
+    return length;
+  }
 
-      while (remainder != 0 && position < max_digits) {
-        bool found = false;
-        size_t cycle_start = 0;
-        for (auto & i : remainder_history) {
-          if (i.first == remainder) {
-            found = true;
-            cycle_start = i.second;
-            break;
-          }
+ private:
+  // Sends the digits of remainder / den_ (0 < remainder < den_) to sink, one chunk per division, and
+  // returns the offset in the digit text where the period starts (npos if it terminates or hits max_digits).
+  // After the pre-period every remainder lies on the cycle, so the period closes exactly when the
+  // remainder at that point comes back: its length is the order of new_base modulo the cofactor of den_.
+  // Digits come chunk_width(new_base) per division. A chunk only exposes its last remainder r, so the
+  // cycle start c is matched as r == c * new_base^m (mod den_): the cycle closed m digits before the chunk end.
+  size_t expand_fraction(BigInteger remainder, const DigitPlan &plan, size_t max_digits,
+                         const std::function<void(const std::string &)> &sink) const {
+    PhaseClock::Scope phase(Phase::divide);
+    size_t pre_period = pre_period_length(plan), width = plan.width;
+    std::vector<BigInteger> shifted_starts;
+    std::optional<LimbDivisor> small_den = den_.limb_divisor();
+    auto reduce_by_den = [&](BigInteger value) {
+      return small_den ? BigInteger::divmod(std::move(value), *small_den) : BigInteger::divmod(value, den_);
+    };
+    std::string piece;
+    size_t count = 0, offset = 0, pre_period_offset = 0;
+    while (remainder != 0 && count < max_digits) {
+      if (count == pre_period && shifted_starts.empty()) {
+        pre_period_offset = offset;
+        BigInteger shifted = remainder;
+        for (size_t m = 1; m <= width; ++m) {
+          shifted = reduce_by_den(shifted * plan.digit_base).second;
+          shifted_starts.push_back(shifted);
         }
-
-        if (found) {
-          fractional_part.insert(cycle_start, "(");
-          fractional_part += ')';
+      }
+      size_t chunk = count < pre_period ? std::min(width, pre_period - count) : width;
+      std::pair<BigInteger, BigInteger> step = reduce_by_den(remainder * plan.powers[chunk]);
+      remainder = std::move(step.second);
+      size_t kept = std::min(chunk, max_digits - count);
+      bool closed = false;
+      for (size_t m = width; count + chunk > pre_period && m > 0; --m) {
+        size_t end = count + chunk - m;
+        if (m <= chunk && end > pre_period && end < max_digits && remainder == shifted_starts[m - 1]) {
+          kept = chunk - m;
+          closed = true;
           break;
         }
-
-        remainder_history.emplace_back(remainder, fractional_part.size());
-
-        remainder = remainder * new_base;
-
-        BigInteger digit = remainder / den_in_base_10;
-        remainder = remainder % den_in_base_10;
-
-        fractional_part += digit.convert_to_string(new_base);
-
-        position++;
       }
-
-      result += fractional_part;
+      piece.clear();
+      BigInteger::append_chunk(piece, kept == chunk ? step.first : step.first / plan.powers[chunk - kept], plan.digit_divisor, kept);
+      sink(piece);
+      count += kept;
+      offset += piece.size();
+      if (closed)
+        return pre_period_offset;
     }
-
-    return result;
+    return std::string::npos;
   }
+
+ public:
    int get_base(){
     return num_.get_base();
   }
@@ -983,7 +2954,10 @@ class BigFraction {
 
 
  private:
-    BigInteger num_, den_;
+    inline static std::atomic<bool> lazy_reduction{false};
+
+    mutable BigInteger num_, den_;
+    mutable bool reduced_ = true;
     int base = num_.get_base();
 };
 
@@ -991,19 +2965,7 @@ BigInteger pow(BigInteger &base, int exponent) {
   if (exponent < 0)
     throw std::invalid_argument("Отрицательные степени не поддерживаются.");
 
-  BigInteger result(1, base.get_base());
-  BigInteger base_copy = base;
-  int exp = exponent;
-
-  while (exp > 0) {
-    if (exp % 2 == 1) {
-      result = result * base_copy;
-    }
-    base_copy = base_copy * base_copy;
-    exp /= 2;
-  }
-
-  return result;
+  return BigInteger::power(base, static_cast<size_t>(exponent));
 }
 
 class Period {
@@ -1032,22 +2994,18 @@ class Period {
     for (int i = 0; i < zeros; ++i) zeros_box += '0';
     BigInteger base_bigint(base, base);
     BigInteger denominator = pow(base_bigint,  get_len(per) - 1) * per;
-    std::cout << "pizda: " << denominator << std::endl;
-    std::cout << "xui: " << get_len(per) << std::endl;
+    BIGNUM_LOG(debug, "pizda: " << denominator);
+    BIGNUM_LOG(debug, "xui: " << get_len(per));
     denominator = {denominator.convert_to_string(base) + zeros_box, base};
-    std::cout << "z1: " << per << " " << denominator << std::endl << std::endl;
+    BIGNUM_LOG(debug, "z1: " << per << " " << denominator);
     return {per, denominator};
   }
 
 
   std::pair<BigInteger, BigInteger> to_fraction() const {
-    std::string temopator;
-    for (int i = 0; i < zeros; ++i) temopator += '0';
     BigInteger numerator(period_digits, base);
-    BigInteger base_bigint(base, base);
-    BigInteger denominator = pow(base_bigint, get_len(numerator)) - BigInteger(1, base);
-    BigInteger xui(denominator.convert_to_string(base) + temopator, base);
-    return {numerator, xui};
+    BigInteger denominator = *BigInteger::power_of(base, BigInteger::digit_count(period_digits)) - BigInteger(1, base);
+    return {numerator, denominator * *BigInteger::power_of(base, zeros)};
   }
 
   [[nodiscard]] std::string get_period_digits() const {
@@ -1155,154 +3113,937 @@ class BigNum {
   };
 
   std::string convert_to_string(int base_new) {
-    std::string ans_integer = integer_part.convert_to_string(base_new);
-    std::string ans_final = ans_integer;
-    if (state_per or state_frac) {
-      ans_final += '.';
-      if (state_per and state_frac){
-
-        ans_final+=total_frac.convert_to_string(base_new);
-      } else{
-        if (state_frac) {
-          ans_final += fractional_part.convert_to_string(base_new);
-        }else {
+    std::string result;
+    size_t period = write_string([&result](const std::string &piece) { result += piece; }, base_new);
+    return BigFraction::with_period(std::move(result), period);
+  }
 
-          std::string ans_period = total_frac.convert_to_string(base_new);
-          ans_final += ans_period;
-        }
-      }
-      if (ans_final[ans_final.size() - 1] == '.') {
-        BigInteger up = integer_part + 1;
-        ans_final = up.convert_to_string(base_new);
-        ans_final+= ".0";
+  // convert_to_string as a stream; returns the offset where the period starts, or std::string::npos.
+  size_t write_string(const std::function<void(const std::string &)> &sink, int base_new,
+                      const BigFraction::DigitPlan *plan = nullptr) {
+    PhaseClock::Scope phase(Phase::format);
+    std::string head = integer_part.convert_to_string(base_new);
+    if (!state_per && !state_frac) {
+      sink(head);
+      return std::string::npos;
+    }
+    head += '.';
+    BigFraction &fraction = state_frac && !state_per ? fractional_part : total_frac;
+    bool started = false;
+    size_t period = fraction.write_string([&](const std::string &piece) {
+      if (!started) {
+        sink(head);
+        started = true;
       }
+      sink(piece);
+    }, base_new, plan);
+    if (!started) {
+      BigInteger up = integer_part + 1;
+      sink(up.convert_to_string(base_new) + ".0");
+      return std::string::npos;
+    }
+    return period == std::string::npos ? period : head.size() + period;
+  }
+};
+
+// Lock-free histogram of non-negative values: four linear buckets per power of two, so a reported
+// percentile is within 25% of the recorded value (exact below 4).
+class Histogram {
+ public:
+  void record(uint64_t value) {
+    buckets_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t seen = max_.load(std::memory_order_relaxed);
+    while (value > seen && !max_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+  }
+
+  [[nodiscard]] uint64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] double mean() const {
+    uint64_t n = count();
+    return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(n) : 0;
+  }
+
+  [[nodiscard]] uint64_t max() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  // Upper bound of the bucket holding the q-quantile, capped at the largest recorded value.
+  [[nodiscard]] uint64_t percentile(double q) const {
+    std::array<uint64_t, bucket_count> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < bucket_count; ++i)
+      total += counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    if (!total)
+      return 0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(total))));
+    for (size_t i = 0, seen = 0; i < bucket_count; ++i) {
+      seen += counts[i];
+      if (seen >= rank)
+        return std::min(bucket_upper(i), max());
+    }
+    return max();
+  }
+
+ private:
+  static constexpr size_t bucket_count = 4 + 62 * 4;
+
+  std::array<std::atomic<uint64_t>, bucket_count> buckets_{};
+  std::atomic<uint64_t> count_{0}, sum_{0}, max_{0};
+
+  static size_t bucket_of(uint64_t value) {
+    if (value < 4)
+      return static_cast<size_t>(value);
+    int top = 63 - __builtin_clzll(value);
+    return 4 + static_cast<size_t>(top - 2) * 4 + ((value >> (top - 2)) & 3);
+  }
+
+  static uint64_t bucket_upper(size_t index) {
+    if (index < 4)
+      return index;
+    int shift = static_cast<int>((index - 4) / 4);
+    uint64_t lower = (4 + (index - 4) % 4) << shift;
+    return lower + ((uint64_t{1} << shift) - 1);
+  }
+};
 
+// Server-wide counters and latency histograms, reported by the "stats" request.
+class ServerStats {
+ public:
+  // Uptime and throughput count from here.
+  void start() {
+    started_ = std::chrono::steady_clock::now();
+  }
+
+  void record_request(const RequestTimings &timings, uint64_t queue_ns, uint64_t total_ns, bool error) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    if (error)
+      errors_.fetch_add(1, std::memory_order_relaxed);
+    queue_.record(queue_ns);
+    total_.record(total_ns);
+    uint32_t entered = timings.entered.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < phase_count; ++i) {
+      if (entered & (1u << i))
+        phases_[i].record(timings.ns[i].load(std::memory_order_relaxed));
     }
-    return ans_final;
+  }
+
+  void record_overload() {
+    overloaded_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void record_send(uint64_t ns) {
+    send_.record(ns);
+  }
+
+  void record_operand(size_t digits) {
+    operand_digits_.record(digits);
+  }
+
+  // Durations in microseconds, operand sizes in characters.
+  [[nodiscard]] std::string to_json(const std::string &cache_json) const {
+    double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    uint64_t requests = requests_.load(std::memory_order_relaxed);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"uptime_s\":" << uptime << ",\"requests\":" << requests
+        << ",\"errors\":" << errors_.load(std::memory_order_relaxed)
+        << ",\"overloaded\":" << overloaded_.load(std::memory_order_relaxed)
+        << ",\"log_dropped\":" << Logger::instance().dropped()
+        << ",\"throughput_rps\":" << (uptime > 0 ? static_cast<double>(requests) / uptime : 0.0)
+        << ",\"queue\":" << histogram_json(queue_, 1e-3) << ",\"total\":" << histogram_json(total_, 1e-3)
+        << ",\"send\":" << histogram_json(send_, 1e-3) << ",\"phases\":{";
+    for (size_t i = 1; i < phase_count; ++i)
+      out << (i > 1 ? "," : "") << "\"" << phase_names[i] << "\":" << histogram_json(phases_[i], 1e-3);
+    out << "},\"operand_digits\":" << histogram_json(operand_digits_, 1) << ",\"cache\":" << cache_json << "}";
+    return out.str();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point started_ = std::chrono::steady_clock::now();
+  std::array<Histogram, phase_count> phases_;
+  Histogram queue_, total_, send_, operand_digits_;
+  std::atomic<uint64_t> requests_{0}, errors_{0}, overloaded_{0};
+
+  static std::string histogram_json(const Histogram &histogram, double scale) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << "{\"count\":" << histogram.count()
+        << ",\"mean\":" << histogram.mean() * scale
+        << ",\"p50\":" << static_cast<double>(histogram.percentile(0.50)) * scale
+        << ",\"p90\":" << static_cast<double>(histogram.percentile(0.90)) * scale
+        << ",\"p99\":" << static_cast<double>(histogram.percentile(0.99)) * scale
+        << ",\"max\":" << static_cast<double>(histogram.max()) * scale << "}";
+    return out.str();
   }
 };
 
-void i_hate_practise() {
-  int server_fd, new_socket;
-  struct sockaddr_in address{};
-  int opt = 1;
-  int addr_len = sizeof(address);
-  char buffer[200000] = {0};
+ServerStats &server_stats() {
+  static ServerStats stats;
+  return stats;
+}
+
+// Bounded LRU of finished conversions, keyed by the normalized request. Thread-safe; a disabled
+// cache neither stores nor counts anything.
+class ResultCache {
+ public:
+  struct Entry {
+    std::string text;
+    size_t period;
+  };
+
+  struct Stats {
+    uint64_t hits, misses, evictions;
+    size_t entries, bytes;
+  };
+
+  void configure(size_t max_bytes, bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    enabled_.store(enabled, std::memory_order_relaxed);
+    evict_to(enabled ? max_bytes_ : 0);
+  }
+
+  [[nodiscard]] bool enabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Larger results are not kept, so one answer cannot flush the whole cache.
+  [[nodiscard]] size_t max_entry_bytes() const {
+    return max_bytes_ / 8;
+  }
+
+  std::shared_ptr<const Entry> find(const std::string &key) {
+    if (!enabled())
+      return nullptr;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++misses_;
+      return nullptr;
+    }
+    ++hits_;
+    order_.splice(order_.begin(), order_, it->second);
+    return it->second->value;
+  }
+
+  void insert(const std::string &key, std::string text, size_t period) {
+    size_t cost = key.size() + text.size() + entry_overhead;
+    if (!enabled() || cost > max_entry_bytes())
+      return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(key))
+      return;
+    order_.push_front({key, std::make_shared<const Entry>(Entry{std::move(text), period}), cost});
+    index_[key] = order_.begin();
+    bytes_ += cost;
+    evict_to(max_bytes_);
+  }
 
-  if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-    std::cerr << "Ошибка при создании сокета" << std::endl;
+  [[nodiscard]] Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {hits_, misses_, evictions_, index_.size(), bytes_};
   }
 
-  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-    std::cerr << "Ошибка при установке опций сокета" << std::endl;
+  [[nodiscard]] std::string to_json() const {
+    Stats current = stats();
+    return "{\"enabled\":" + std::string(enabled() ? "true" : "false") + ",\"hits\":" + std::to_string(current.hits) +
+           ",\"misses\":" + std::to_string(current.misses) + ",\"evictions\":" + std::to_string(current.evictions) +
+           ",\"entries\":" + std::to_string(current.entries) + ",\"bytes\":" + std::to_string(current.bytes) + "}";
   }
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(65432);
 
-  if (bind(server_fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
-    std::cerr << "Ошибка при привязке сокета" << std::endl;
+ private:
+  struct Node {
+    std::string key;
+    std::shared_ptr<const Entry> value;
+    size_t cost;
+  };
+
+  static constexpr size_t entry_overhead = 96;
+
+  mutable std::mutex mutex_;
+  std::list<Node> order_;
+  std::unordered_map<std::string, std::list<Node>::iterator> index_;
+  size_t max_bytes_ = 64 << 20, bytes_ = 0;
+  std::atomic<bool> enabled_{true};
+  uint64_t hits_ = 0, misses_ = 0, evictions_ = 0;
+
+  void evict_to(size_t limit) {
+    while (bytes_ > limit) {
+      bytes_ -= order_.back().cost;
+      index_.erase(order_.back().key);
+      order_.pop_back();
+      ++evictions_;
+    }
   }
+};
 
-  if (listen(server_fd, 3) < 0) {
-    std::cerr << "Ошибка при прослушивании" << std::endl;
+ResultCache &result_cache() {
+  static ResultCache cache;
+  return cache;
+}
+
+// Digits are case-insensitive on input, as in BigInteger::read.
+std::string normalized_number(std::string value) {
+  for (auto &c : value)
+    c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+  return value;
+}
+
+// Text (without parentheses) and period offset of one conversion, from the result cache when key
+// is there. Otherwise compute writes the text to the sink it is given and the result is stored.
+// With stream set the text goes to sink as it is produced instead of into text.
+size_t cached_conversion(const std::string &key, bool stream, const std::function<void(const std::string &)> &sink,
+                         std::string &text, const std::function<size_t(const std::function<void(const std::string &)> &)> &compute) {
+  ResultCache &cache = result_cache();
+  if (auto hit = cache.find(key)) {
+    if (stream)
+      sink(hit->text);
+    else
+      text = hit->text;
+    return hit->period;
   }
 
-  std::cout << "Ожидание подключения..." << std::endl;
+  std::string captured;
+  bool capturing = cache.enabled();
+  size_t period = compute([&](const std::string &piece) {
+    if (!stream) {
+      text += piece;
+      return;
+    }
+    sink(piece);
+    if (capturing && captured.size() + piece.size() > cache.max_entry_bytes()) {
+      capturing = false;
+      std::string().swap(captured);
+    } else if (capturing) {
+      captured += piece;
+    }
+  });
+  if (!stream)
+    cache.insert(key, text, period);
+  else if (capturing)
+    cache.insert(key, std::move(captured), period);
+  return period;
+}
+
+// "batch,<current_base>,<target_base>,<number>,<number>,...": answers one line per number, in order;
+// a number that fails to parse gets its error message on its line. The items are spread over pool.
+void handle_batch(const std::string &received_data, const std::function<void(const std::string &)> &sink,
+                  ThreadPool *pool) {
+  std::vector<std::string> fields;
+  for (size_t start = 0, end; start <= received_data.size(); start = end + 1) {
+    end = std::min(received_data.find(',', start), received_data.size());
+    fields.push_back(received_data.substr(start, end - start));
+  }
+  if (fields.size() < 3) {
+    sink("Ошибка: Некорректные входные данные. batch");
+    return;
+  }
 
-  while (true) {
-    if ((new_socket = accept(server_fd, (struct sockaddr *) &address, (socklen_t *) &addr_len)) < 0) {
-      std::cerr << "Ошибка при принятии соединения" << std::endl;
-      continue;
+  int current_base, target_base;
+  std::unique_ptr<BigFraction::DigitPlan> plan;
+  try {
+    current_base = std::stoi(fields[1]);
+    target_base = std::stoi(fields[2]);
+    plan = std::make_unique<BigFraction::DigitPlan>(target_base);
+  } catch (const std::exception &e) {
+    sink("Ошибка: Некорректные входные данные. " + std::string(e.what()));
+    return;
+  }
+  BIGNUM_LOG(info, "Пакет: " << fields.size() - 3 << " чисел, " << current_base << " -> " << target_base);
+
+  size_t count = fields.size() - 3;
+  std::vector<std::string> results(count);
+  RequestTimings *timings = PhaseClock::timings();
+  auto convert_range = [&](size_t begin, size_t end) {
+    PhaseClock::Bind bind(timings);
+    for (size_t i = begin; i < end; ++i) {
+      server_stats().record_operand(fields[3 + i].size());
+      try {
+        std::string key = "convert," + normalized_number(fields[3 + i]) + "," + std::to_string(current_base) + "," +
+                          std::to_string(target_base);
+        std::string text;
+        size_t period = cached_conversion(key, false, nullptr, text, [&](const std::function<void(const std::string &)> &out) {
+          PhaseClock::Scope constructing(Phase::construct);
+          BigNum number(fields[3 + i], current_base);
+          constructing.finish();
+          return number.write_string(out, target_base, plan.get());
+        });
+        results[i] = BigFraction::with_period(std::move(text), period);
+      } catch (const std::exception &e) {
+        results[i] = "Ошибка: Некорректные входные данные. " + std::string(e.what());
+      }
     }
+  };
+
+  size_t parts = pool ? std::min(count, pool->size() * 4) : 1;
+  if (parts <= 1) {
+    convert_range(0, count);
+  } else {
+    std::vector<std::function<void()>> tasks;
+    for (size_t part = 0; part < parts; ++part)
+      tasks.emplace_back([&, part] { convert_range(count * part / parts, count * (part + 1) / parts); });
+    pool->run_all(tasks);
+  }
 
-    int val_read = static_cast<int>((read(new_socket, buffer, 1024)));
-    std::string received_data(buffer, val_read);
+  for (size_t i = 0; i < count; ++i) {
+    sink(results[i]);
+    if (i + 1 < count)
+      sink("\n");
+  }
+}
 
-    std::string type, float_value, int_value1, int_value2, oper;
-    size_t pos = 0;
-    int index = 0;
+// "convert_stream,..." and "arif_stream,...": the response is written to sink as the digits are produced.
+bool is_stream_request(std::string_view request) {
+  std::string_view type = request.substr(0, request.find(','));
+  const std::string_view suffix = "_stream";
+  return type.size() > suffix.size() && type.substr(type.size() - suffix.size()) == suffix;
+}
 
-    while ((pos = received_data.find(',')) != std::string::npos) {
-      if (index == 0) {
-        type = received_data.substr(0, pos);
-      } else if (index == 1) {
-        float_value = received_data.substr(0, pos);
-      } else if (index == 2) {
-        int_value1 = received_data.substr(0, pos);
+// Parses one request in the comma-separated format and writes the whole response to sink.
+// "stats" answers with the server's counters and latency percentiles as one JSON object.
+void handle_request(std::string received_data, const std::function<void(const std::string &)> &sink,
+                    ThreadPool *pool = nullptr) {
+  if (received_data.rfind("batch,", 0) == 0) {
+    handle_batch(received_data, sink, pool);
+    return;
+  }
+  if (received_data == "stats") {
+    sink(server_stats().to_json(result_cache().to_json()));
+    return;
+  }
+  PhaseClock::Scope parsing(Phase::parse);
+  std::string type, float_value, int_value1, int_value2, oper;
+  size_t pos = 0;
+  int index = 0;
+  bool stream = false;
+
+  while ((pos = received_data.find(',')) != std::string::npos) {
+    if (index == 0) {
+      type = received_data.substr(0, pos);
+      // "convert_stream" / "arif_stream": digits are sent as they are produced, then "\nperiod:<offset>".
+      const std::string stream_suffix = "_stream";
+      if (type.size() > stream_suffix.size() && type.compare(type.size() - stream_suffix.size(), std::string::npos, stream_suffix) == 0) {
+        type.erase(type.size() - stream_suffix.size());
+        stream = true;
+      }
+    } else if (index == 1) {
+      float_value = received_data.substr(0, pos);
+    } else if (index == 2) {
+      int_value1 = received_data.substr(0, pos);
+    }
+    if (type == "arif"){
+      if (index == 3){
+        oper = received_data.substr(0, pos);
       }
-      if (type == "arif"){
-        if (index == 3){
-          oper = received_data.substr(0, pos);
+    }
+
+    received_data.erase(0, pos + 1);
+    index++;
+  }
+  int_value2 = received_data;
+  std::string response;
+  size_t period = std::string::npos;
+  parsing.finish();
+  server_stats().record_operand(float_value.size());
+  if (type == "arif")
+    server_stats().record_operand(int_value1.size());
+
+  // Every failure is reported as the response text, so a stream still ends with its period trailer.
+  try {
+    if (type == "convert") {
+      BIGNUM_LOG(info, "Полученные данные:\nЧисло для перевода: " << float_value << "\nТекущая система счисления: "
+                       << int_value1 << "\nЦелевая система счисления: " << int_value2);
+
+      int current_base = std::stoi(int_value1);
+      int target_base = std::stoi(int_value2);
+      std::string key = "convert," + normalized_number(float_value) + "," + std::to_string(current_base) + "," +
+                        std::to_string(target_base);
+
+      std::string text;
+      period = cached_conversion(key, stream, sink, text, [&](const std::function<void(const std::string &)> &out) {
+        PhaseClock::Scope constructing(Phase::construct);
+        BigNum inputNumber(float_value, current_base);
+        constructing.finish();
+        return inputNumber.write_string(out, target_base);
+      });
+      if (!stream)
+        response = BigFraction::with_period(std::move(text), period);
+    } else if (type == "arif" && int_value2 != "+" && int_value2 != "-" && int_value2 != "*" && int_value2 != "/") {
+      // The operation is the last field of "arif,a,b,base,op"; an unknown one is not computed or cached.
+      throw std::invalid_argument("Неизвестная операция: " + int_value2);
+    } else if (type == "arif") {
+      std::swap(int_value2, oper);
+
+      int current_base = std::stoi(int_value2);
+      std::string key = "arif," + normalized_number(float_value) + "," + normalized_number(int_value1) + "," +
+                        std::to_string(current_base) + "," + oper;
+
+      std::string text;
+      period = cached_conversion(key, stream, sink, text, [&](const std::function<void(const std::string &)> &out) {
+        PhaseClock::Scope constructing(Phase::construct);
+        BigNum firs = {static_cast<std::string>(float_value), current_base};
+        BigNum ces = {static_cast<std::string>(int_value1), current_base};
+        constructing.finish();
+
+        PhaseClock::Scope computing(Phase::arithmetic);
+        BigFraction result;
+        if (oper == "+") result = firs + ces;
+        if (oper == "-") result = firs - ces;
+        if (oper == "*") result = firs * ces;
+        if (oper == "/") result = firs / ces;
+        computing.finish();
+        return result.write_string_full(out);
+      });
+      if (!stream)
+        response = BigFraction::with_period(std::move(text), period);
+    } else {
+      response = "Ошибка: NoType";
+    }
+  } catch (const std::invalid_argument &e) {
+    response = "Ошибка: Некорректные входные данные. " + std::string(e.what());
+    BIGNUM_LOG(error, response);
+  } catch (const std::out_of_range &e) {
+    response = "Ошибка: Входные данные выходят за допустимые границы. " + std::string(e.what());
+    BIGNUM_LOG(error, response);
+  } catch (const std::exception &e) {
+    response = "Ошибка: Непредвиденная ошибка. " + std::string(e.what());
+    BIGNUM_LOG(error, response);
+  } catch (...) {
+    response = "Ошибка: Неизвестная ошибка.";
+    BIGNUM_LOG(error, response);
+  }
+  BIGNUM_LOG(info, response);
+  sink(response);
+  if (stream)
+    sink("\nperiod:" + (period == std::string::npos ? std::string("-1") : std::to_string(period)));
+}
+
+struct ServerOptions {
+  uint16_t port = 65432;
+  size_t workers = std::max(1u, std::thread::hardware_concurrency());
+  // Requests accepted but not yet started; further requests are answered with an error at once.
+  size_t queue_size = 256;
+  int backlog = SOMAXCONN;
+  size_t max_request_bytes = 1 << 16;
+  // Per connection: a worker producing a streamed response waits while this much is unsent.
+  size_t max_buffered_bytes = 1 << 20;
+  // Result cache; disable it to measure the cold path.
+  size_t cache_bytes = 64 << 20;
+  bool cache_enabled = true;
+};
+
+// Wire formats, chosen by the first byte a client sends:
+//  * compatibility: one comma-separated request, answered in plain text, then the server closes;
+//  * framed (first byte 0): any number of frames "u32 length | u64 request id | payload", integers
+//    big-endian, length counting the payload only. Payloads are comma-separated requests; each is
+//    answered by one frame with the same id, in completion order. A "_stream" request is answered
+//    by any number of frames with its id as the digits are produced, then an empty frame that ends
+//    the stream. The connection stays open until the client shuts down its side and every answer
+//    has been sent.
+struct Connection {
+  uint64_t id = 0;
+  int fd = -1;
+  // I/O thread only.
+  std::string input;
+  bool framed = false, reading = true;
+  // Shared with the workers.
+  std::mutex mutex;
+  std::condition_variable drained;
+  std::string outbox;
+  size_t in_flight = 0;
+  bool closed = false;
+};
+
+// Single epoll I/O thread for accept/read/write; requests run on a fixed ThreadPool.
+class Server {
+ public:
+  explicit Server(ServerOptions options) : options_(options), workers_(std::max<size_t>(options.workers, 1)) {}
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  // Serves until the process ends; returns false if the listening socket cannot be set up.
+  bool run() {
+    int opt = 1;
+    struct sockaddr_in address{};
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_fd_ < 0) {
+      BIGNUM_LOG(error, "Ошибка при создании сокета");
+      return false;
+    }
+    if (setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+      BIGNUM_LOG(error, "Ошибка при установке опций сокета");
+    }
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(options_.port);
+    if (bind(listen_fd_, (struct sockaddr *) &address, sizeof(address)) < 0) {
+      BIGNUM_LOG(error, "Ошибка при привязке сокета");
+      return false;
+    }
+    if (listen(listen_fd_, options_.backlog) < 0) {
+      BIGNUM_LOG(error, "Ошибка при прослушивании");
+      return false;
+    }
+
+    result_cache().configure(options_.cache_bytes, options_.cache_enabled);
+    server_stats().start();
+    epoll_fd_ = epoll_create1(0);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK);
+    watch(listen_fd_, listen_id, EPOLLIN, EPOLL_CTL_ADD);
+    watch(wake_fd_, wake_id, EPOLLIN, EPOLL_CTL_ADD);
+    BIGNUM_LOG(info, "Ожидание подключения...");
+
+    std::vector<epoll_event> events(256);
+    while (true) {
+      int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+      for (int i = 0; i < ready; ++i) {
+        uint64_t id = events[i].data.u64;
+        if (id == listen_id) {
+          accept_all();
+        } else if (id == wake_id) {
+          flush_ready();
+        } else {
+          auto it = connections_.find(id);
+          if (it == connections_.end())
+            continue;
+          std::shared_ptr<Connection> connection = it->second;
+          if (events[i].events & (EPOLLERR | EPOLLHUP))
+            drop(connection);
+          else if (events[i].events & (EPOLLIN | EPOLLOUT)) {
+            if (events[i].events & EPOLLIN)
+              read_input(connection);
+            if (events[i].events & EPOLLOUT)
+              flush(connection);
+          }
         }
       }
+    }
+  }
+
+ private:
+  static constexpr uint64_t listen_id = 0, wake_id = 1;
+  static constexpr size_t frame_header = 12;
+
+  ServerOptions options_;
+  ThreadPool workers_;
+  std::atomic<size_t> queued_{0};
+  int listen_fd_ = -1, epoll_fd_ = -1, wake_fd_ = -1;
+  uint64_t next_id_ = 2;
+  std::unordered_map<uint64_t, std::shared_ptr<Connection>> connections_;
+  std::mutex ready_mutex_;
+  std::vector<uint64_t> ready_;
+
+  void watch(int fd, uint64_t id, uint32_t events, int op) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    epoll_ctl(epoll_fd_, op, fd, &event);
+  }
 
-      received_data.erase(0, pos + 1);
-      index++;
+  void accept_all() {
+    while (true) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+      if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+          BIGNUM_LOG(error, "Ошибка при принятии соединения");
+        if (errno != EINTR)
+          return;
+        continue;
+      }
+      auto connection = std::make_shared<Connection>();
+      connection->id = next_id_++;
+      connection->fd = fd;
+      connections_[connection->id] = connection;
+      watch(fd, connection->id, EPOLLIN, EPOLL_CTL_ADD);
     }
-    int_value2 = received_data;
-    std::string response;
+  }
 
-    if (type == "convert"){
+  static std::string frame(const std::string &payload, uint64_t request_id) {
+    std::string out;
+    put_be(out, payload.size(), 4);
+    put_be(out, request_id, 8);
+    return out + payload;
+  }
 
-      std::cout << "Полученные данные:" << std::endl;
-      std::cout << "Число для перевода: " << float_value << std::endl;
-      std::cout << "Текущая система счисления: " << int_value1 << std::endl;
-      std::cout << "Целевая система счисления: " << int_value2 << std::endl;
+  static void put_be(std::string &out, uint64_t value, int bytes) {
+    for (int i = bytes; i-- > 0;)
+      out += static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
 
+  static uint64_t get_be(const std::string &in, size_t at, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+      value = (value << 8) | static_cast<unsigned char>(in[at + i]);
+    return value;
+  }
 
-      try {
-        int current_base = std::stoi(int_value1);
-        int target_base = std::stoi(int_value2);
+  void read_input(const std::shared_ptr<Connection> &connection) {
+    char buffer[4096];
+    bool eof = false;
+    while (true) {
+      ssize_t n = read(connection->fd, buffer, sizeof(buffer));
+      if (n > 0) {
+        connection->input.append(buffer, static_cast<size_t>(n));
+        if (connection->input.size() > options_.max_request_bytes + frame_header)
+          break;
+        continue;
+      }
+      if (n < 0 && errno == EINTR)
+        continue;
+      eof = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+      break;
+    }
 
-        BigNum inputNumber(float_value, current_base);
+    if (!connection->framed && !connection->input.empty() && connection->input[0] == '\0') {
+      connection->framed = true;
+      connection->input.erase(0, 1);
+    }
+    if (connection->framed) {
+      size_t at = 0;
+      while (connection->input.size() - at >= frame_header) {
+        uint64_t length = get_be(connection->input, at, 4);
+        if (length > options_.max_request_bytes) {
+          drop(connection);
+          return;
+        }
+        if (connection->input.size() - at < frame_header + length)
+          break;
+        uint64_t request_id = get_be(connection->input, at + 4, 8);
+        dispatch(connection, connection->input.substr(at + frame_header, length), request_id);
+        at += frame_header + length;
+      }
+      connection->input.erase(0, at);
+    } else if (!connection->input.empty()) {
+      // The request is whatever the client sent in one go, as with the old blocking read.
+      if (connection->input.size() > options_.max_request_bytes)
+        connection->input.resize(options_.max_request_bytes);
+      connection->reading = false;
+      dispatch(connection, std::move(connection->input), 0);
+    }
+    if (eof)
+      connection->reading = false;
+    flush(connection);
+  }
 
-        response = inputNumber.convert_to_string(target_base);
-      } catch (const std::invalid_argument &e) {
-        response = "Ошибка: Некорректные входные данные. " + std::string(e.what());
-        std::cerr << response << std::endl;
-      } catch (const std::out_of_range &e) {
-        response = "Ошибка: Входные данные выходят за допустимые границы. " + std::string(e.what());
-        std::cerr << response << std::endl;
+  void dispatch(const std::shared_ptr<Connection> &connection, std::string request, uint64_t request_id) {
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      ++connection->in_flight;
+    }
+    bool framed = connection->framed, stream = framed && is_stream_request(request);
+    // A "_stream" answer ends with the period trailer even when it is an error.
+    std::string trailer = is_stream_request(request) ? "\nperiod:-1" : "";
+    if (queued_.load(std::memory_order_relaxed) >= options_.queue_size) {
+      server_stats().record_overload();
+      std::string overloaded = "Ошибка: Сервер перегружен, повторите запрос позже." + trailer;
+      if (stream)
+        append(connection, frame(overloaded, request_id), false);
+      complete(connection, stream ? "" : overloaded, framed, request_id, false);
+      return;
+    }
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    auto queued_at = std::chrono::steady_clock::now();
+    workers_.submit([this, connection, request = std::move(request), framed, stream, trailer, request_id,
+                     queued_at]() mutable {
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      auto started = std::chrono::steady_clock::now();
+      RequestTimings timings;
+      bool error = false, answered = false;
+      std::string pending;
+      auto sink = [&](const std::string &piece) {
+        if (!answered && !piece.empty()) {
+          answered = true;
+          error = piece.rfind("Ошибка", 0) == 0;
+        }
+        pending += piece;
+        if ((stream || !framed) && pending.size() >= 1 << 16) {
+          append(connection, stream ? frame(pending, request_id) : pending);
+          pending.clear();
+        }
+      };
+      try {
+        PhaseClock::Bind bind(&timings);
+        handle_request(std::move(request), sink, &workers_);
       } catch (const std::exception &e) {
-        response = "Ошибка: Непредвиденная ошибка. " + std::string(e.what());
-        std::cerr << response << std::endl;
+        pending += "Ошибка: Непредвиденная ошибка. " + std::string(e.what()) + trailer;
+        error = true;
       } catch (...) {
-        response = "Ошибка: Неизвестная ошибка.";
-        std::cerr << response << std::endl;
+        pending += "Ошибка: Неизвестная ошибка." + trailer;
+        error = true;
       }
+      if (stream && !pending.empty())
+        append(connection, frame(pending, request_id));
+      complete(connection, stream ? "" : pending, framed, request_id);
+      auto finished = std::chrono::steady_clock::now();
+      server_stats().record_request(timings, std::chrono::duration_cast<std::chrono::nanoseconds>(started - queued_at).count(),
+                                    std::chrono::duration_cast<std::chrono::nanoseconds>(finished - queued_at).count(), error);
+    });
+  }
 
+  // Worker side: queue output for the I/O thread, waiting while too much of it is unsent (the I/O
+  // thread itself must not wait). A compatibility or "_stream" response is sent in pieces; any other
+  // framed one is appended whole by complete().
+  void append(const std::shared_ptr<Connection> &connection, const std::string &data, bool wait = true) {
+    {
+      std::unique_lock<std::mutex> lock(connection->mutex);
+      connection->drained.wait(lock, [&] {
+        return !wait || connection->closed || connection->outbox.size() < options_.max_buffered_bytes;
+      });
+      if (connection->closed)
+        return;
+      connection->outbox += data;
+    }
+    notify(connection->id);
+  }
 
+  void complete(const std::shared_ptr<Connection> &connection, const std::string &data, bool framed, uint64_t request_id,
+                bool wait = true) {
+    append(connection, framed ? frame(data, request_id) : data, wait);
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      --connection->in_flight;
+    }
+    notify(connection->id);
+  }
 
-    } else if (type == "arif"){
-      std::swap(int_value2, oper);
-
-      int current_base = std::stoi(int_value2);
-      BigNum firs = {static_cast<std::string>(float_value), current_base};
-      BigNum ces = {static_cast<std::string>(int_value1), current_base};
+  void notify(uint64_t id) {
+    {
+      std::lock_guard<std::mutex> lock(ready_mutex_);
+      ready_.push_back(id);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+    (void) ignored;
+  }
 
-      if (oper == "+") response = BigFraction(firs + ces).convert_to_string_full();
-      if (oper == "-") response = BigFraction(firs - ces).convert_to_string_full();
-      if (oper == "*") response = BigFraction(firs * ces).convert_to_string_full();
-      if (oper == "/") response = BigFraction(firs / ces).convert_to_string_full();
+  void flush_ready() {
+    uint64_t count;
+    while (read(wake_fd_, &count, sizeof(count)) > 0) {}
+    std::vector<uint64_t> ready;
+    {
+      std::lock_guard<std::mutex> lock(ready_mutex_);
+      ready.swap(ready_);
+    }
+    for (uint64_t id : ready) {
+      auto it = connections_.find(id);
+      if (it != connections_.end())
+        flush(it->second);
+    }
+  }
 
-    }else{
-      response = "Ошибка: NoType";
+  // I/O side: send what the socket takes, then re-arm epoll, or close once nothing more can follow.
+  void flush(const std::shared_ptr<Connection> &connection) {
+    bool done;
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      auto sending = std::chrono::steady_clock::now();
+      size_t sent = 0;
+      while (sent < connection->outbox.size()) {
+        ssize_t n = send(connection->fd, connection->outbox.data() + sent, connection->outbox.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+          sent += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+          continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          break;
+        } else {
+          connection->closed = true;
+          break;
+        }
+      }
+      connection->outbox.erase(0, sent);
+      if (sent)
+        server_stats().record_send(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - sending).count());
+      done = connection->closed || (!connection->reading && !connection->in_flight && connection->outbox.empty());
+      if (!done) {
+        uint32_t events = 0;
+        if (connection->reading)
+          events |= EPOLLIN;
+        if (!connection->outbox.empty())
+          events |= EPOLLOUT;
+        watch(connection->fd, connection->id, events, EPOLL_CTL_MOD);
+      }
     }
-    std::cout << std::endl << response << std::endl;
-    send(new_socket, response.c_str(), response.size(), 0);
+    connection->drained.notify_all();
+    if (done)
+      drop(connection);
+  }
 
-    close(new_socket);
+  // Closes the socket; a worker still computing for it sees closed and discards its output.
+  void drop(const std::shared_ptr<Connection> &connection) {
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      connection->closed = true;
+      connection->outbox.clear();
+    }
+    connection->drained.notify_all();
+    if (connections_.erase(connection->id))
+      close(connection->fd);
   }
-}
+};
 
-int main() {
-  i_hate_practise();
-  std::string float_value = "0.8(00001112222221321411111118306)";
-  int current_base = 12, target_base =  10;
+bool i_hate_practise(const ServerOptions &options = {}) {
+  Server server(options);
+  return server.run();
+}
 
-  BigNum inputNumber(float_value, current_base);
+#ifndef BIGNUM_NO_MAIN
+// Whole decimal option value; rejects signs, trailing characters and values above max.
+size_t parse_option(const std::string &value, size_t max = SIZE_MAX) {
+  size_t used = 0;
+  if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+    throw std::invalid_argument(value);
+  unsigned long long result = std::stoull(value, &used);
+  if (used != value.size())
+    throw std::invalid_argument(value);
+  if (result > max)
+    throw std::out_of_range(value);
+  return static_cast<size_t>(result);
+}
 
-  std::string response = inputNumber.convert_to_string(target_base);
-  std::cout << response;
-}
\ No newline at end of file
+int main(int argc, char **argv) {
+  ServerOptions options;
+  // Threads one large multiplication may use (1 = off) and the operand size in limbs from which it does.
+  size_t parallel_threads = 1, parallel_threshold = 4096;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg.rfind("--workers=", 0) == 0)
+        options.workers = parse_option(arg.substr(10));
+      else if (arg.rfind("--parallel-threads=", 0) == 0)
+        parallel_threads = parse_option(arg.substr(19), 1024);
+      else if (arg.rfind("--parallel-threshold=", 0) == 0)
+        parallel_threshold = parse_option(arg.substr(21));
+      else if (arg.rfind("--queue=", 0) == 0)
+        options.queue_size = parse_option(arg.substr(8));
+      else if (arg.rfind("--port=", 0) == 0)
+        options.port = static_cast<uint16_t>(parse_option(arg.substr(7), UINT16_MAX));
+      else if (arg.rfind("--cache-bytes=", 0) == 0)
+        options.cache_bytes = parse_option(arg.substr(14));
+      else if (arg == "--no-cache")
+        options.cache_enabled = false;
+      else if (arg == "--lazy-reduction")
+        BigFraction::set_lazy_reduction(true);
+      else if (arg.rfind("--log-level=", 0) == 0)
+        Logger::set_level(Logger::parse_level(arg.substr(12)));
+      else
+        throw std::invalid_argument("Unknown option: " + arg);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Некорректный параметр: " << e.what() << "\n"
+              << "Использование: " << argv[0]
+              << " [--port=N] [--workers=N] [--parallel-threads=N] [--parallel-threshold=LIMBS] [--queue=N]"
+                 " [--cache-bytes=N] [--no-cache] [--lazy-reduction] [--log-level=debug|info|warning|error|off]\n";
+    return EXIT_FAILURE;
+  }
+  BigInteger::set_parallel_multiply(parallel_threads, parallel_threshold);
+  bool served = i_hate_practise(options);
+  Logger::instance().flush();
+  return served ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
\ No newline at end of file
@@ -1,5 +1,9 @@
 import sys
+import codecs
 import socket
+import struct
+import threading
+import itertools
 from PyQt5.QtWidgets import (
     QApplication, QMainWindow, QWidget, QLabel, QLineEdit, QTextEdit, QPushButton,
     QVBoxLayout, QHBoxLayout, QFileDialog, QMessageBox, QProgressBar, QFrame, QTabWidget
@@ -7,13 +11,88 @@ from PyQt5.QtWidgets import (
 from PyQt5.QtCore import Qt, pyqtSignal, QThread
 from PyQt5.QtGui import QFont, QIcon
 
+class FramedConnection:
+    """Одно постоянное соединение с сервером: запросы в кадрах "u32 длина | u64 id | данные",
+    ответы приходят в любом порядке и сопоставляются по id. Ответ на "_stream"-запрос приходит
+    несколькими кадрами с одним id и заканчивается пустым кадром; каждый непустой кадр
+    передаётся в on_chunk по мере получения."""
+
+    def __init__(self, host='localhost', port=65432):
+        self.address = (host, port)
+        self.sock = None
+        self.lock = threading.Lock()
+        self.ids = itertools.count(1)
+        self.waiting = {}
+
+    def _connect(self):
+        self.sock = socket.create_connection(self.address, timeout=30)
+        self.sock.settimeout(None)
+        self.sock.sendall(b"\0")
+        threading.Thread(target=self._read_loop, args=(self.sock,), daemon=True).start()
+
+    def _read_loop(self, sock):
+        buffer = b""
+        try:
+            while True:
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                buffer += chunk
+                while len(buffer) >= 12:
+                    length, request_id = struct.unpack(">IQ", buffer[:12])
+                    if len(buffer) < 12 + length:
+                        break
+                    payload, buffer = buffer[12:12 + length], buffer[12 + length:]
+                    with self.lock:
+                        slot = self.waiting.get(request_id)
+                        if slot and (not slot[2] or not payload):
+                            del self.waiting[request_id]
+                    if slot:
+                        slot[3] += payload
+                        if slot[2] and payload:
+                            slot[2](payload)
+                        if not slot[2] or not payload:
+                            slot[1] = slot[3].decode('utf-8')
+                            slot[0].set()
+        except OSError:
+            pass
+        with self.lock:
+            if self.sock is sock:
+                self.sock = None
+            pending, self.waiting = self.waiting, {}
+        for slot in pending.values():
+            slot[0].set()
+
+    def request(self, payload, timeout=30, on_chunk=None):
+        slot = [threading.Event(), None, on_chunk, b""]
+        with self.lock:
+            if self.sock is None:
+                self._connect()
+            request_id = next(self.ids)
+            self.waiting[request_id] = slot
+            data = payload.encode('utf-8')
+            self.sock.sendall(struct.pack(">IQ", len(data), request_id) + data)
+        if not slot[0].wait(timeout):
+            with self.lock:
+                self.waiting.pop(request_id, None)
+            raise socket.timeout()
+        if slot[1] is None:
+            raise ConnectionError("Соединение с сервером разорвано.")
+        return slot[1]
+
+
+connection = FramedConnection()
+
+
 class NetworkThread(QThread):
     result_ready = pyqtSignal(str)
+    partial_ready = pyqtSignal(str)
     error_occurred = pyqtSignal(str)
     connection_status = pyqtSignal(str, str)
 
-    def __init__(self, typy, float_value, int_value1, int_value2, operation = None):
+    def __init__(self, typy, float_value, int_value1, int_value2, operation = None, stream = False):
         super().__init__()
+        self.stream = stream
         if typy == "convert":
             self.type = "convert"
             self.float_value = float_value
@@ -31,18 +110,32 @@ class NetworkThread(QThread):
         try:
             self.connection_status.emit("Подключение...", "orange")
 
+            request_type = f"{self.type}_stream" if self.stream else self.type
             if (self.type == "convert"):
-                data_to_send = f"{self.type},{self.float_value},{self.int_value1},{self.int_value2}"
+                data_to_send = f"{request_type},{self.float_value},{self.int_value1},{self.int_value2}"
             elif (self.type == "arif"):
-                data_to_send = f"{self.type},{self.float_value1},{self.float_value2},{self.base},{self.operation}"
+                data_to_send = f"{request_type},{self.float_value1},{self.float_value2},{self.base},{self.operation}"
+
+
 
+            if self.stream:
+                # Потоковый ответ: цифры без скобок приходят по частям, в конце строка "\nperiod:<смещение>".
+                decoder = codecs.getincrementaldecoder('utf-8')()
+                received = []
 
+                def on_chunk(chunk):
+                    received.append(decoder.decode(chunk))
+                    self.partial_ready.emit("".join(received).partition("\nperiod:")[0])
 
-            with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
-                s.settimeout(30)
-                s.connect(('localhost', 65432))
-                s.sendall(data_to_send.encode('utf-8'))
-                response = s.recv(1000000).decode('utf-8')
+                response = connection.request(data_to_send, on_chunk=on_chunk)
+                digits, trailer, period = response.rpartition("\nperiod:")
+                # Ответ без строки периода (например, ошибка) показывается как есть.
+                if trailer and period.lstrip("-").isdigit():
+                    response = digits
+                    if int(period) >= 0:
+                        response = response[:int(period)] + "(" + response[int(period):] + ")"
+            else:
+                response = connection.request(data_to_send)
 
             self.result_ready.emit(response)
             self.connection_status.emit("Соединение установлено", "green")
@@ -284,8 +377,9 @@ class ConverterWindow(QMainWindow):
 
         self.start_loading()
 
-        self.thread = NetworkThread("convert", float_value, int_value1, int_value2)
+        self.thread = NetworkThread("convert", float_value, int_value1, int_value2, stream=True)
         self.thread.result_ready.connect(self.update_response)
+        self.thread.partial_ready.connect(self.update_response)
         self.thread.error_occurred.connect(self.show_error)
         self.thread.connection_status.connect(self.update_connection_status)
         self.thread.finished.connect(self.stop_loading)
@@ -303,8 +397,9 @@ class ConverterWindow(QMainWindow):
 
         self.start_loading()
 
-        self.thread = NetworkThread("arif", num1, num2, num3, operation)
+        self.thread = NetworkThread("arif", num1, num2, num3, operation, stream=True)
         self.thread.result_ready.connect(self.update_arithmetic_response)
+        self.thread.partial_ready.connect(self.update_arithmetic_response)
         self.thread.error_occurred.connect(self.show_error)
         self.thread.connection_status.connect(self.update_connection_status)
         self.thread.finished.connect(self.stop_loading)